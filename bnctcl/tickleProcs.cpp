@@ -1017,12 +1017,24 @@ const char* getbncuser(const char* User, const char* Type, const char* Parameter
 		return Context->GetAutoBacklog();
 	} else if (strcasecmp(Type, "sysnotices") == 0) {
 		return Context->GetSystemNotices() ? "1" : "0";
+	} else if (strcasecmp(Type, "floodrate") == 0 || strcasecmp(Type, "floodburst") == 0) {
+		int rc = asprintf(&Buffer, "%u", strcasecmp(Type, "floodrate") == 0 ?
+			Context->GetFloodRate() : Context->GetFloodBurst());
+
+		if (RcFailed(rc)) {
+			g_Bouncer->Fatal();
+		}
+
+		return Buffer;
+	} else if (strcasecmp(Type, "floodfairness") == 0) {
+		return Context->GetFloodFairness() ? "1" : "0";
 	} else {
 		throw "Type should be one of: server port serverpass client clientcount "
 			"realname nick realnick awaynick away awaymessage uptime lock admin hasserver "
 			"hasclient vhost channels tag delayjoin seen quitasaway automodes "
 			"dropmodes suspendreason ssl sslclient realserver network ident tags localip "
-			"lean memory memorylimit channelsort sessions autobacklog sysnotices";
+			"lean memory memorylimit channelsort sessions autobacklog sysnotices "
+			"floodrate floodburst floodfairness";
 	}
 }
 
@@ -1085,11 +1097,17 @@ int setbncuser(const char* User, const char* Type, const char* Value, const char
 		Context->SetAutoBacklog(Value);
 	else if (strcasecmp(Type, "sysnotices") == 0)
 		Context->SetSystemNotices(Value);
+	else if (strcasecmp(Type, "floodrate") == 0)
+		Context->SetFloodRate(atoi(Value));
+	else if (strcasecmp(Type, "floodburst") == 0)
+		Context->SetFloodBurst(atoi(Value));
+	else if (strcasecmp(Type, "floodfairness") == 0)
+		Context->SetFloodFairness(Value ? (atoi(Value) ? true : false) : false);
 	else
 		throw "Type should be one of: server port serverpass realname nick awaynick "
 			"away awaymessage lock admin channels tag vhost delayjoin password "
 			"quitasaway automodes dropmodes suspendreason ident lean channelsort "
-			"autobacklog sysnotices";
+			"autobacklog sysnotices floodrate floodburst floodfairness";
 
 	return 1;
 }
@@ -42,6 +42,10 @@ CChannel::CChannel(const char *Name, CIRCConnection *Owner) {
 
 	m_Nicks.RegisterValueDestructor(DestroyObject<CNick>);
 
+	if (Owner != NULL) {
+		m_Nicks.SetCaseMapping(Owner->GetCaseMapping());
+	}
+
 	m_HasNames = false;
 	m_ModesValid = false;
 	m_KeepNicklist = true;
@@ -521,6 +525,17 @@ const CHashtable<CNick *, false> *CChannel::GetNames(void) const {
 	return &m_Nicks;
 }
 
+/**
+ * SetCaseMapping
+ *
+ * Sets the casemapping which is used for comparing nicks.
+ *
+ * @param CaseMapping the case-folding table
+ */
+void CChannel::SetCaseMapping(const unsigned char *CaseMapping) {
+	m_Nicks.SetCaseMapping(CaseMapping);
+}
+
 /**
  * ClearModes
  *
@@ -603,10 +618,8 @@ bool CChannel::SendWhoReply(CClientConnection *Client, bool Simulate) const {
 		return false;
 	}
 
-	int a = 0;
-
-	while (hash_t<CNick *> *NickHash = GetNames()->Iterate(a++)) {
-		CNick *NickObj = NickHash->Value;
+	for (CHashtable<CNick *, false>::Cursor NickCursor(GetNames()); NickCursor.IsValid(); NickCursor.Proceed()) {
+		CNick *NickObj = NickCursor->Value;
 
 		if ((SiteTemp = NickObj->GetSite()) == NULL) {
 			return false;
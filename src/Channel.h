@@ -113,6 +113,7 @@ public:
 	bool HasNames(void) const;
 	void SetHasNames(void);
 	const CHashtable<CNick *, false> *GetNames(void) const;
+	void SetCaseMapping(const unsigned char *CaseMapping);
 
 	void ClearModes(void);
 	bool AreModesValid(void) const;
@@ -92,6 +92,51 @@ CClientConnection::~CClientConnection() {
 	delete m_Capabilities;
 }
 
+/**
+ * GetListenerStats
+ *
+ * Returns the combined accept counters for an IPv4 and an IPv6 listener.
+ *
+ * @param Listener the IPv4 listener (or NULL)
+ * @param ListenerV6 the IPv6 listener (or NULL)
+ * @param Accepts returns the number of accepted connections
+ * @param RecentAccepts returns the number of recently accepted connections
+ */
+static void GetListenerStats(CClientListener *Listener, CClientListener *ListenerV6,
+		unsigned int *Accepts, unsigned int *RecentAccepts) {
+	*Accepts = 0;
+	*RecentAccepts = 0;
+
+	if (Listener != NULL) {
+		*Accepts += Listener->GetAcceptCount();
+		*RecentAccepts += Listener->GetRecentAccepts();
+	}
+
+	if (ListenerV6 != NULL) {
+		*Accepts += ListenerV6->GetAcceptCount();
+		*RecentAccepts += ListenerV6->GetRecentAccepts();
+	}
+}
+
+/**
+ * GetKernelTLSDescription
+ *
+ * Describes which directions of a TLS connection are encrypted by the kernel.
+ *
+ * @param KernelTLS the connection's kernel_tls_e flags
+ */
+static const char *GetKernelTLSDescription(int KernelTLS) {
+	if ((KernelTLS & KernelTLS_Send) && (KernelTLS & KernelTLS_Recv)) {
+		return "send/receive";
+	} else if (KernelTLS & KernelTLS_Send) {
+		return "send";
+	} else if (KernelTLS & KernelTLS_Recv) {
+		return "receive";
+	} else {
+		return "off";
+	}
+}
+
 /**
  * ProcessBncCommand
  *
@@ -136,7 +181,9 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		return false;
 	}
 
-	if (strcasecmp(Subcommand, "help") == 0) {
+	int CommandCode = GetBncCommand(Subcommand);
+
+	if (CommandCode == BncCommand_Help) {
 		if (argc <= 1) {
 			SENDUSER("--The following commands are available to you--");
 			SENDUSER("--Used as '/sbnc <command>', or '/msg -sbnc <command>'");
@@ -246,7 +293,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 	}
 
-	if (strcasecmp(Subcommand, "help") == 0) {
+	if (CommandCode == BncCommand_Help) {
 		if (argc <= 1) {
 			// show help
 			hash_t<command_t *> *Hash;
@@ -350,7 +397,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		return false;
 	}
 
-	if (strcasecmp(Subcommand, "lsmod") == 0 && GetOwner()->IsAdmin()) {
+	if (CommandCode == BncCommand_Lsmod && GetOwner()->IsAdmin()) {
 		for (int i = 0; i < Modules->GetLength(); i++) {
 			rc = asprintf(&Out, "%d: %s", i + 1, (*Modules)[i]->GetFilename());
 
@@ -365,7 +412,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("End of MODULES.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "insmod") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Insmod && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: INSMOD module-path");
 			return false;
@@ -390,7 +437,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "rmmod") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Rmmod && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: RMMOD module-id");
 			return false;
@@ -411,7 +458,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "globalunset") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Globalunset && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: globalunset option");
 		} else {
@@ -428,7 +475,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "globalset") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Globalset && GetOwner()->IsAdmin()) {
 		if (argc < 3) {
 			SENDUSER("Configurable settings:");
 			SENDUSER("--");
@@ -459,7 +506,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "unset") == 0) {
+	} else if (CommandCode == BncCommand_Unset) {
 		if (argc < 2) {
 			SENDUSER("Syntax: unset option");
 		} else {
@@ -476,7 +523,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "set") == 0) {
+	} else if (CommandCode == BncCommand_Set) {
 		if (argc < 3) {
 			SENDUSER("Configurable settings:");
 			SENDUSER("--");
@@ -585,6 +632,24 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 				SENDUSER(Out);
 				free(Out);
 			}
+
+			rc = asprintf(&Out, "floodrate - %u lines per minute", GetOwner()->GetFloodRate());
+			if (!RcFailed(rc)) {
+				SENDUSER(Out);
+				free(Out);
+			}
+
+			rc = asprintf(&Out, "floodburst - %u lines", GetOwner()->GetFloodBurst());
+			if (!RcFailed(rc)) {
+				SENDUSER(Out);
+				free(Out);
+			}
+
+			rc = asprintf(&Out, "floodfairness - %s", GetOwner()->GetFloodFairness() ? "On" : "Off");
+			if (!RcFailed(rc)) {
+				SENDUSER(Out);
+				free(Out);
+			}
 		} else {
 			if (strcasecmp(argv[1], "server") == 0) {
 				if (argc > 3) {
@@ -697,6 +762,30 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 				} else {
 					SENDUSER("Value must be either 'on' or 'off'.");
 
+					return false;
+				}
+			} else if (strcasecmp(argv[1], "floodrate") == 0 || strcasecmp(argv[1], "floodburst") == 0) {
+				int Value = atoi(argv[2]);
+
+				if (Value <= 0) {
+					SENDUSER("Value must be a positive number.");
+
+					return false;
+				}
+
+				if (strcasecmp(argv[1], "floodrate") == 0) {
+					GetOwner()->SetFloodRate(Value);
+				} else {
+					GetOwner()->SetFloodBurst(Value);
+				}
+			} else if (strcasecmp(argv[1], "floodfairness") == 0) {
+				if (strcasecmp(argv[2], "on") == 0) {
+					GetOwner()->SetFloodFairness(true);
+				} else if (strcasecmp(argv[2], "off") == 0) {
+					GetOwner()->SetFloodFairness(false);
+				} else {
+					SENDUSER("Value must be either 'on' or 'off'.");
+
 					return false;
 				}
 			} else {
@@ -709,7 +798,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 
 		return false;
 #ifdef HAVE_LIBSSL
-	} else if (strcasecmp(Subcommand, "savecert") == 0) {
+	} else if (CommandCode == BncCommand_Savecert) {
 		if (!IsSSL()) {
 			SENDUSER("Error: You are not using an SSL-encrypted connection.");
 		} else if (GetPeerCertificate() == NULL) {
@@ -721,7 +810,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "showcert") == 0) {
+	} else if (CommandCode == BncCommand_Showcert) {
 		char Buffer[300];
 		const CVector<X509 *> *Certificates;
 		X509_NAME *name;
@@ -766,7 +855,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("End of CERTIFICATES.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "delcert") == 0) {
+	} else if (CommandCode == BncCommand_Delcert) {
 		int id;
 
 		if (argc < 2) {
@@ -798,12 +887,12 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 
 		return false;
 #endif /* HAVE_LIBSSL */
-	} else if (strcasecmp(Subcommand, "die") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Die && GetOwner()->IsAdmin()) {
 		g_Bouncer->Log("Shutdown requested by %s", GetOwner()->GetUsername());
 		g_Bouncer->Shutdown();
 
 		return false;
-	} else if (strcasecmp(Subcommand, "adduser") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Adduser && GetOwner()->IsAdmin()) {
 		const char *Password;
 		char RandomPassword[10];
 
@@ -853,7 +942,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("Done.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "deluser") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Deluser && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: DELUSER username");
 			return false;
@@ -874,7 +963,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "simul") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Simul && GetOwner()->IsAdmin()) {
 		if (argc < 3) {
 			SENDUSER("Syntax: SIMUL username :command");
 			return false;
@@ -896,7 +985,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "direct") == 0) {
+	} else if (CommandCode == BncCommand_Direct) {
 		if (argc < 2) {
 			SENDUSER("Syntax: DIRECT :command");
 			return false;
@@ -908,7 +997,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		IRC->WriteLine("%s", argv[1]);
 
 		return false;
-	} else if (strcasecmp(Subcommand, "broadcast") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Broadcast && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: BROADCAST :text");
 			return false;
@@ -917,7 +1006,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		ArgRejoinArray(argv, 1);
 		g_Bouncer->GlobalNotice(argv[1]);
 		return false;
-	} else if (strcasecmp(Subcommand, "kill") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Kill && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: KILL username [reason]");
 			return false;
@@ -948,7 +1037,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		free(Out);
 
 		return false;
-	} else if (strcasecmp(Subcommand, "disconnect") == 0) {
+	} else if (CommandCode == BncCommand_Disconnect) {
 		CUser *User;
 
 		if (GetOwner()->IsAdmin() && argc >= 2) {
@@ -981,7 +1070,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("Done.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "jump") == 0) {
+	} else if (CommandCode == BncCommand_Jump) {
 		if (GetOwner()->GetIRCConnection()) {
 			GetOwner()->GetIRCConnection()->Kill("Reconnecting");
 
@@ -995,7 +1084,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "status") == 0) {
+	} else if (CommandCode == BncCommand_Status) {
 		rc = asprintf(&Out, "Username: %s", GetOwner()->GetUsername());
 		if (!RcFailed(rc)) {
 			SENDUSER(Out);
@@ -1020,6 +1109,16 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 			free(Out);
 		}
 
+#ifdef HAVE_LIBSSL
+		if (IsSSL()) {
+			rc = asprintf(&Out, "Client: kernel TLS: %s", GetKernelTLSDescription(GetKernelTLS()));
+			if (!RcFailed(rc)) {
+				SENDUSER(Out);
+				free(Out);
+			}
+		}
+#endif /* HAVE_LIBSSL */
+
 		CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
 		if (IRC) {
@@ -1029,6 +1128,16 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 				free(Out);
 			}
 
+#ifdef HAVE_LIBSSL
+			if (IRC->IsSSL()) {
+				rc = asprintf(&Out, "IRC: kernel TLS: %s", GetKernelTLSDescription(IRC->GetKernelTLS()));
+				if (!RcFailed(rc)) {
+					SENDUSER(Out);
+					free(Out);
+				}
+			}
+#endif /* HAVE_LIBSSL */
+
 			SENDUSER("Channels:");
 
 			int a = 0;
@@ -1046,8 +1155,30 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 			free(Out);
 		}
 
+#ifdef HAVE_LIBSSL
+		if (GetOwner()->IsAdmin()) {
+			rc = asprintf(&Out, "Connections using kernel TLS: %u", g_Bouncer->GetKernelTLSConnections());
+			if (!RcFailed(rc)) {
+				SENDUSER(Out);
+				free(Out);
+			}
+
+			SSL_CTX *SSLContext = g_Bouncer->GetSSLContext();
+
+			if (SSLContext != NULL) {
+				rc = asprintf(&Out, "SSL handshakes: %ld (%ld resumed sessions, %ld cached sessions)",
+					SSL_CTX_sess_accept_good(SSLContext), SSL_CTX_sess_hits(SSLContext),
+					SSL_CTX_sess_number(SSLContext));
+				if (!RcFailed(rc)) {
+					SENDUSER(Out);
+					free(Out);
+				}
+			}
+		}
+#endif /* HAVE_LIBSSL */
+
 		return false;
-	} else if (strcasecmp(Subcommand, "impulse") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Impulse && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: impulse command");
 
@@ -1063,7 +1194,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "who") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Who && GetOwner()->IsAdmin()) {
 		char **Keys = g_Bouncer->GetUsers()->GetSortedKeys();
 		int Count = g_Bouncer->GetUsers()->GetLength();
 
@@ -1133,7 +1264,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("End of USERS.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "addlistener") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Addlistener && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 #ifdef USESSL
 			SENDUSER("Syntax: addlistener <port> [address] [ssl]");
@@ -1179,7 +1310,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("Done.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "dellistener") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Dellistener && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: dellistener <port>");
 
@@ -1195,9 +1326,14 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "listeners") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Listeners && GetOwner()->IsAdmin()) {
+		unsigned int Accepts, RecentAccepts;
+
 		if (g_Bouncer->GetMainListener() != NULL) {
-			rc = asprintf(&Out, "Main listener: port %d", g_Bouncer->GetMainListener()->GetPort());
+			GetListenerStats(g_Bouncer->GetMainListener(), g_Bouncer->GetMainListenerV6(), &Accepts, &RecentAccepts);
+
+			rc = asprintf(&Out, "Main listener: port %d (%u connections accepted, %u in the last minute)",
+				g_Bouncer->GetMainListener()->GetPort(), Accepts, RecentAccepts);
 		} else {
 			Out = strdup("Main listener: none");
 			rc = (Out == NULL) ? -1 : 0;
@@ -1210,7 +1346,10 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 
 #ifdef USESSL
 		if (g_Bouncer->GetMainSSLListener() != NULL) {
-			rc = asprintf(&Out, "Main SSL listener: port %d", g_Bouncer->GetMainSSLListener()->GetPort());
+			GetListenerStats(g_Bouncer->GetMainSSLListener(), g_Bouncer->GetMainSSLListenerV6(), &Accepts, &RecentAccepts);
+
+			rc = asprintf(&Out, "Main SSL listener: port %d (%u connections accepted, %u in the last minute)",
+				g_Bouncer->GetMainSSLListener()->GetPort(), Accepts, RecentAccepts);
 		} else {
 			Out = strdup("Main SSL listener: none");
 			rc = (Out == NULL) ? -1 : 0;
@@ -1228,19 +1367,26 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		CVector<additionallistener_t> *Listeners = g_Bouncer->GetAdditionalListeners();
 
 		for (int i = 0; i < Listeners->GetLength(); i++) {
+			GetListenerStats(static_cast<CClientListener *>((*Listeners)[i].Listener),
+				static_cast<CClientListener *>((*Listeners)[i].ListenerV6), &Accepts, &RecentAccepts);
+
 #ifdef USESSL
 			if ((*Listeners)[i].SSL) {
 				if ((*Listeners)[i].BindAddress != NULL) {
-					rc = asprintf(&Out, "Port: %d (SSL, bound to %s)", (*Listeners)[i].Port, (*Listeners)[i].BindAddress);
+					rc = asprintf(&Out, "Port: %d (SSL, bound to %s, %u connections accepted, %u in the last minute)",
+						(*Listeners)[i].Port, (*Listeners)[i].BindAddress, Accepts, RecentAccepts);
 				} else {
-					rc = asprintf(&Out, "Port: %d (SSL)", (*Listeners)[i].Port);
+					rc = asprintf(&Out, "Port: %d (SSL, %u connections accepted, %u in the last minute)",
+						(*Listeners)[i].Port, Accepts, RecentAccepts);
 				}
 			} else {
 #endif
 				if ((*Listeners)[i].BindAddress != NULL) {
-					rc = asprintf(&Out, "Port: %d (bound to %s)", (*Listeners)[i].Port, (*Listeners)[i].BindAddress);
+					rc = asprintf(&Out, "Port: %d (bound to %s, %u connections accepted, %u in the last minute)",
+						(*Listeners)[i].Port, (*Listeners)[i].BindAddress, Accepts, RecentAccepts);
 				} else {
-					rc = asprintf(&Out, "Port: %d", (*Listeners)[i].Port);
+					rc = asprintf(&Out, "Port: %d (%u connections accepted, %u in the last minute)",
+						(*Listeners)[i].Port, Accepts, RecentAccepts);
 				}
 #ifdef USESSL
 			}
@@ -1254,7 +1400,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("End of LISTENERS.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "read") == 0) {
+	} else if (CommandCode == BncCommand_Read) {
 		GetOwner()->GetLog()->PlayToUser(this, NoticeUser ? Log_Notice : Log_Message);
 
 		if (!GetOwner()->GetLog()->IsEmpty()) {
@@ -1268,7 +1414,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "erase") == 0) {
+	} else if (CommandCode == BncCommand_Erase) {
 		if (GetOwner()->GetLog()->IsEmpty()) {
 			SENDUSER("Your personal log is empty.");
 		} else {
@@ -1277,7 +1423,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "playmainlog") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Playmainlog && GetOwner()->IsAdmin()) {
 		g_Bouncer->GetLog()->PlayToUser(this, NoticeUser ? Log_Notice : Log_Message);
 
 		if (!g_Bouncer->GetLog()->IsEmpty()) {
@@ -1291,13 +1437,13 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "erasemainlog") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Erasemainlog && GetOwner()->IsAdmin()) {
 		g_Bouncer->GetLog()->Clear();
 		g_Bouncer->Log("User %s erased the main log", GetOwner()->GetUsername());
 		SENDUSER("Done.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "admin") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Admin && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: ADMIN username");
 
@@ -1315,7 +1461,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "unadmin") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Unadmin && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: UNADMIN username");
 
@@ -1333,7 +1479,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "suspend") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Suspend && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: SUSPEND username :reason");
 
@@ -1370,7 +1516,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "unsuspend") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Unsuspend && GetOwner()->IsAdmin()) {
 		if (argc < 2) {
 			SENDUSER("Syntax: UNSUSPEND username");
 
@@ -1392,7 +1538,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "resetpass") == 0 && GetOwner()->IsAdmin()) {
+	} else if (CommandCode == BncCommand_Resetpass && GetOwner()->IsAdmin()) {
 		if (argc < 3) {
 			SENDUSER("Syntax: RESETPASS username new-password");
 
@@ -1410,7 +1556,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		}
 
 		return false;
-	} else if (strcasecmp(Subcommand, "partall") == 0) {
+	} else if (CommandCode == BncCommand_Partall) {
 		if (GetOwner()->GetIRCConnection()) {
 			const char *Channels = GetOwner()->GetConfigChannels();
 
@@ -1424,7 +1570,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("Done.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "backlog") == 0) {
+	} else if (CommandCode == BncCommand_Backlog) {
 		if (argc < 2) {
 			SENDUSER("Syntax: BACKLOG #channel");
 
@@ -1450,7 +1596,7 @@ bool CClientConnection::ProcessBncCommand(const char *Subcommand, int argc, cons
 		SENDUSER("Done.");
 
 		return false;
-	} else if (strcasecmp(Subcommand, "erasebacklog") == 0) {
+	} else if (CommandCode == BncCommand_Erasebacklog) {
 		CIRCConnection *IRC;
 
 		IRC = GetOwner()->GetIRCConnection();
@@ -1520,9 +1666,10 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 	}
 
 	const char *Command = argv[0];
+	int CommandCode = GetIRCCommand(Command);
 
 	if (GetOwner() == NULL) {
-		if (strcasecmp(Command, "nick") == 0 && argc > 1) {
+		if (CommandCode == IRCCommand_Nick && argc > 1) {
 			const char *Nick = argv[1];
 
 			if (m_Nick != NULL) {
@@ -1540,7 +1687,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 				WriteUnformattedLine(":sbnc.beutner.name NOTICE AUTH :*** This server requires a "
 					"password. Use /QUOTE PASS thepassword to supply a password now.");
 			}
-		} else if (strcasecmp(Command, "pass") == 0) {
+		} else if (CommandCode == IRCCommand_Pass) {
 			if (argc < 2) {
 				WriteLine(":sbnc.beutner.name 461 %s :Not enough parameters", m_Nick);
 			} else {
@@ -1551,7 +1698,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 			ValidateUser();
 
 			return false;
-		} else if (strcasecmp(Command, "user") == 0 && argc > 1) {
+		} else if (CommandCode == IRCCommand_User && argc > 1) {
 			if (m_Username && m_Nick) {
 				WriteLine(":sbnc.beutner.name 462 %s :You may not reregister", m_Nick);
 			} else {
@@ -1578,11 +1725,11 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 			}
 
 			return false;
-		} else if (strcasecmp(Command, "quit") == 0) {
+		} else if (CommandCode == IRCCommand_Quit) {
 			Kill("*** Thanks for flying with shroudBNC. :)");
 
 			return false;
-		} else if (strcasecmp(Command, "cap") == 0) {
+		} else if (CommandCode == IRCCommand_Cap) {
 			if (argc > 1 && strcasecmp(argv[1], "ls") == 0) {
 				m_CapabilitiesEnd = true;
 				char caps[512];
@@ -1676,7 +1823,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 	}
 
 	if (GetOwner() != NULL) {
-		if (strcasecmp(Command, "quit") == 0) {
+		if (CommandCode == IRCCommand_Quit) {
 			char *QuitReason;
 			bool QuitAsAway = GetOwner()->GetUseQuitReason();
 
@@ -1698,14 +1845,14 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 
 			Kill("*** Thanks for flying with shroudBNC. :)");
 			return false;
-		} else if (strcasecmp(Command, "nick") == 0) {
+		} else if (CommandCode == IRCCommand_Nick) {
 			if (argc >= 2) {
 				free(m_Nick);
 				m_Nick = strdup(argv[1]);
 
 				GetOwner()->SetNick(argv[1]);
 			}
-		} else if (argc > 1 && strcasecmp(Command, "join") == 0) {
+		} else if (argc > 1 && CommandCode == IRCCommand_Join) {
 			CIRCConnection *IRC;
 			const char *Key;
 
@@ -1716,7 +1863,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 
 				return false;
 			}
-		} else if (strcasecmp(Command, "whois") == 0) {
+		} else if (CommandCode == IRCCommand_Whois) {
 			if (argc >= 2) {
 				const char *Nick = argv[1];
 
@@ -1728,7 +1875,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 					return false;
 				}
 			}
-		} else if (argc > 2 && strcasecmp(Command, "privmsg") == 0 && strcasecmp(argv[1], "-sbnc") == 0) {
+		} else if (argc > 2 && CommandCode == IRCCommand_Privmsg && strcasecmp(argv[1], "-sbnc") == 0) {
 			tokendata_t Tokens;
 			
 			Tokens = ArgTokenize2(argv[2]);
@@ -1740,7 +1887,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 			ArgFreeArray(Arr);
 
 			return false;
-		} else if (argc > 2 && strcasecmp(Command, "privmsg") == 0) {
+		} else if (argc > 2 && CommandCode == IRCCommand_Privmsg) {
 			CVector<client_t> *Clients = GetOwner()->GetClientConnections();
 			const char *Site;
 			char *Hostmask;
@@ -1784,7 +1931,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 			}
 
 			free(Hostmask);
-		} else if (argc > 2 && strcasecmp(Command, "notice") == 0) {
+		} else if (argc > 2 && CommandCode == IRCCommand_Notice) {
 			const char *Site;
 
 			if (GetOwner()->GetIRCConnection() == NULL) {
@@ -1798,7 +1945,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 
 				return false;
 			}
-		} else if (strcasecmp(Command, "userhost") == 0) {
+		} else if (CommandCode == IRCCommand_Userhost) {
 			if (argc == 2 && strcasecmp(argv[1], m_Nick) == 0) {
 				const char *Server, *Ident;
 				CIRCConnection *IRC;
@@ -1821,21 +1968,21 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 
 				return false;
 			}
-		} else if (argc > 1 && strcasecmp(Command, "ping") == 0) {
+		} else if (argc > 1 && CommandCode == IRCCommand_Ping) {
 			if (GetOwner()->GetIRCConnection() == NULL) {
 				WriteLine(":sbnc.beutner.name PONG :%s", argv[1]);
 
 				return false;
 			}
-		} else if (strcasecmp(Command, "protoctl") == 0) {
+		} else if (CommandCode == IRCCommand_Protoctl) {
 			if (argc > 1 && strcasecmp(argv[1], "namesx") == 0) {
 				m_NamesXSupport = true;
 
 				return false;
 			}
-		} else if (strcasecmp(Command, "sbnc") == 0) {
+		} else if (CommandCode == IRCCommand_Sbnc) {
 			return ProcessBncCommand(argv[1], argc - 1, &argv[1], true);
-		} else if (strcasecmp(Command, "synth") == 0) {
+		} else if (CommandCode == IRCCommand_Synth) {
 			if (argc < 2) {
 				Privmsg("Syntax: SYNTH command parameter");
 				Privmsg("supported commands are: mode, topic, names, version, version-forcereply, who");
@@ -1843,7 +1990,9 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 				return false;
 			}
 
-			if (strcasecmp(argv[1], "mode") == 0 && argc > 2) {
+			int SynthCommand = GetIRCCommand(argv[1]);
+
+			if (SynthCommand == IRCCommand_Mode && argc > 2) {
 				CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
 				if (IRC) {
@@ -1872,7 +2021,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 							IRC->WriteLine("MODE %s +b", argv[2]);
 					}
 				}
-			} else if (strcasecmp(argv[1], "topic") == 0 && argc > 2) {
+			} else if (SynthCommand == IRCCommand_Topic && argc > 2) {
 				CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
 				if (IRC) {
@@ -1887,7 +2036,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 						IRC->WriteLine("TOPIC %s", argv[2]);
 					}
 				}
-			} else if (strcasecmp(argv[1], "names") == 0 && argc > 2) {
+			} else if (SynthCommand == IRCCommand_Names && argc > 2) {
 				CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
 				if (IRC) {
@@ -1974,7 +2123,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 						IRC->WriteLine("NAMES %s", argv[2]);
 					}
 				}
-			} else if (strcasecmp(argv[1], "who") == 0 && argc > 2) {
+			} else if (SynthCommand == IRCCommand_Who && argc > 2) {
 				CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
 				if (IRC) {
@@ -1986,7 +2135,7 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 						IRC->WriteLine("WHO %s", argv[2]);
 					}
 				}
-			} else if ((strcasecmp(argv[1], "version") == 0 || strcasecmp(argv[1], "version-forcereply") == 0) && argc >= 2) {
+			} else if ((SynthCommand == IRCCommand_Version || strcasecmp(argv[1], "version-forcereply") == 0) && argc >= 2) {
 				CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
 				if (IRC != NULL) {
@@ -2065,9 +2214,9 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 			}
 
 			return false;
-		} else if (strcasecmp(Command, "mode") == 0 || strcasecmp(Command, "topic") == 0 ||
-				strcasecmp(Command, "names") == 0 || strcasecmp(Command, "who") == 0) {
-			if (argc == 2 || ((strcasecmp(Command, "mode") == 0 && argc == 3) && strcmp(argv[2],"+b") == 0)) {
+		} else if (CommandCode == IRCCommand_Mode || CommandCode == IRCCommand_Topic ||
+				CommandCode == IRCCommand_Names || CommandCode == IRCCommand_Who) {
+			if (argc == 2 || ((CommandCode == IRCCommand_Mode && argc == 3) && strcmp(argv[2],"+b") == 0)) {
 				if (argc == 2) {
 					rc = asprintf(&Out, "SYNTH %s :%s", argv[0], argv[1]);
 				} else {
@@ -2081,13 +2230,20 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
 
 				return false;
 			}
-		} else if (strcasecmp(Command, "version") == 0 && argc <= 2) {
+		} else if (CommandCode == IRCCommand_Version && argc <= 2) {
 			ParseLine("SYNTH VERSION");
 
 			return false;
-		} else if (strcasecmp(Command, "pong") == 0 && argc > 1 && strcasecmp(argv[1], "sbnc") == 0) {
+		} else if (CommandCode == IRCCommand_Pong && argc > 1 && strcasecmp(argv[1], "sbnc") == 0) {
 			return false;
-		} else if (strcasecmp(Command, "ison") == 0 && GetUser()->GetIRCConnection() == NULL) {
+		} else if (CommandCode == IRCCommand_Tagmsg) {
+			CIRCConnection *IRC = GetOwner()->GetIRCConnection();
+
+			// there's nothing left of a TAGMSG once its tags are removed
+			if (IRC == NULL || !IRC->HasMessageTags()) {
+				return false;
+			}
+		} else if (CommandCode == IRCCommand_Ison && GetUser()->GetIRCConnection() == NULL) {
 			for (int i = 1; i < argc; i++) {
 				if (strcasecmp(argv[i], "-sbnc") == 0) {
 					CIRCConnection *IRC = GetOwner()->GetIRCConnection();
@@ -2118,29 +2274,25 @@ bool CClientConnection::ParseLineArgV(int argc, const char **argv) {
  * @param Line the line
  */
 void CClientConnection::ParseLine(const char *Line) {
-	if (strlen(Line) > 512) {
+	// the 512 byte limit does not include the line's tags
+	if (strlen(ArgStripTags(Line)) > 512 || strlen(Line) >= IRCMESSAGE_MAXLENGTH) {
 		return; // protocol violation
 	}
 
 	bool ReturnValue;
-	tokendata_t Args;
-	const char **argv, **real_argv;
+	ircmessage_t Message;
+	const char **argv;
 	int argc;
 
-	Args = ArgTokenize2(Line);
-	argv = real_argv = ArgToArray2(Args);
+	ArgTokenizeMessage(Line, &Message);
 
-	if (AllocFailed(argv)) {
-		return;
-	}
-
-	argc = ArgCount2(Args);
+	argv = Message.ArgV;
+	argc = Message.ArgC;
 
-	if (argc > 0) {
-		if (argv[0][0] == ':') {
-			argv = &argv[1];
-			argc--;
-		}
+	// the prefix is ignored for lines which were sent by clients
+	if (Message.Prefix != NULL) {
+		argv = &argv[1];
+		argc--;
 	}
 
 	if (argc > 0) {
@@ -2149,8 +2301,6 @@ void CClientConnection::ParseLine(const char *Line) {
 		ReturnValue = true;
 	}
 
-	ArgFreeArray(real_argv);
-
 	if (GetOwner() != NULL && ReturnValue) {
 		CIRCConnection *IRC = GetOwner()->GetIRCConnection();
 
@@ -2450,6 +2600,38 @@ int CClientConnection::Read(bool DontProcess) {
 void CClientConnection::WriteUnformattedLine(const char *Line) {
 	CConnection::WriteUnformattedLine(Line);
 
+	CheckSendQ();
+}
+
+/**
+ * WriteSharedLine
+ *
+ * Sends a shared line to the client. Unless the client has enabled the
+ * message-tags capability the line's tags are skipped and TAGMSG lines are
+ * dropped altogether.
+ *
+ * @param Line the line
+ */
+void CClientConnection::WriteSharedLine(CSharedLine *Line) {
+	if (Line->GetTagsLength() > 0 && !HasCapability("message-tags")) {
+		if (ArgIsTagmsg(Line->GetData())) {
+			return;
+		}
+
+		m_SendQ->WriteSharedLine(Line, Line->GetTagsLength());
+	} else {
+		CConnection::WriteSharedLine(Line);
+	}
+
+	CheckSendQ();
+}
+
+/**
+ * CheckSendQ
+ *
+ * Disconnects the client if its sendq exceeds the limit.
+ */
+void CClientConnection::CheckSendQ(void) {
 	if (GetOwner() != NULL && !GetOwner()->IsAdmin() && GetSendqSize() > g_Bouncer->GetSendqSize() * 1024) {
 		FlushSendQ();
 		CConnection::WriteUnformattedLine("");
@@ -2530,11 +2712,12 @@ clientdata_t CClientConnection::Hijack(void) {
 	g_Bouncer->UnregisterSocket(ClientData.Socket);
 	SetSocket(INVALID_SOCKET);
 
-	ClientData.RecvQ = m_RecvQ;
+	ClientData.RecvQ = DetachRecvQ();
 	ClientData.SendQ = m_SendQ;
+	ClientData.SendQ->SetNotifyProc(NULL, NULL);
 
-	m_RecvQ = new CFIFOBuffer();
 	m_SendQ = new CFIFOBuffer();
+	m_SendQ->SetNotifyProc(ConnectionQueueChanged, static_cast<CConnection *>(this));
 
 	if (IsSSL()) {
 		ClientData.SSLObject = m_SSL;
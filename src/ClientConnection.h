@@ -83,6 +83,7 @@ private:
 	virtual const char *GetClassName(void) const;
 	bool ParseLineArgV(int argc, const char **argv);
 	bool ProcessBncCommand(const char *Subcommand, int argc, const char **argv, bool NoticeUser);
+	void CheckSendQ(void);
 
 public:
 #ifndef SWIG
@@ -113,6 +114,9 @@ public:
 	virtual const char *GetQuitReason(void) const;
 
 	virtual void WriteUnformattedLine(const char *Line);
+#ifndef SWIG
+	virtual void WriteSharedLine(CSharedLine *Line);
+#endif /* SWIG */
 
 	virtual CHashtable<const char *, false> *GetCapabilities(void);
 	virtual bool HasCapability(const char *cap) const;
@@ -138,6 +142,17 @@ class SBNCAPI CFakeClient : public CClientConnection {
 	virtual void WriteUnformattedLine(const char *Line) {
 		m_Queue.WriteUnformattedLine(Line);
 	}
+
+	/**
+	 * WriteSharedLine
+	 *
+	 * Re-implementation of CClientConnection::WriteSharedLine.
+	 *
+	 * @param Line the line
+	 */
+	virtual void WriteSharedLine(CSharedLine *Line) {
+		m_Queue.WriteSharedLine(Line);
+	}
 public:
 	/**
 	 * CFakeClient
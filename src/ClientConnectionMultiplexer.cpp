@@ -91,9 +91,41 @@ void CClientConnectionMultiplexer::RealNotice(const char *Text) {
 
 void CClientConnectionMultiplexer::WriteUnformattedLine(const char *Line) {
 	CVector<client_t> *Clients = GetOwner()->GetClientConnections();
+	CSharedLine *SharedLine = NULL;
+
+	// a single client doesn't benefit from sharing the line
+	if (Clients->GetLength() > 1) {
+		SharedLine = CSharedLine::Create(Line);
+	}
+
+	if (SharedLine == NULL) {
+		for (int i = 0; i < Clients->GetLength(); i++) {
+			CClientConnection *Client = (*Clients)[i].Client;
+
+			// only clients which have enabled message-tags get the line's tags
+			if (Line[0] == '@' && !Client->HasCapability("message-tags")) {
+				// there's nothing left of a TAGMSG once its tags are gone
+				if (!ArgIsTagmsg(Line)) {
+					Client->WriteUnformattedLine(ArgStripTags(Line));
+				}
+			} else {
+				Client->WriteUnformattedLine(Line);
+			}
+		}
+
+		return;
+	}
+
+	WriteSharedLine(SharedLine);
+
+	SharedLine->Release();
+}
+
+void CClientConnectionMultiplexer::WriteSharedLine(CSharedLine *Line) {
+	CVector<client_t> *Clients = GetOwner()->GetClientConnections();
 
 	for (int i = 0; i < Clients->GetLength(); i++) {
-		(*Clients)[i].Client->WriteUnformattedLine(Line);
+		(*Clients)[i].Client->WriteSharedLine(Line);
 	}
 }
 
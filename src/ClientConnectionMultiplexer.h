@@ -50,6 +50,9 @@ public:
 	virtual void Shutdown(void);
 
 	virtual void WriteUnformattedLine(const char *Line);
+#ifndef SWIG
+	virtual void WriteSharedLine(CSharedLine *Line);
+#endif /* SWIG */
 };
 
 #endif /* CLIENTCONNECTIONMULTIPLEXER_H */
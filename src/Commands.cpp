@@ -0,0 +1,235 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/* Commands are looked up with a switch over their length and their first and
+ * last character, which identifies at most two candidates; the compiler builds
+ * the actual lookup table and rejects keys which are used twice. A single
+ * strcasecmp() confirms the match. */
+#define COMMAND_KEY(Length, First, Last) (((Length) << 16) | ((First) << 8) | (Last))
+
+/**
+ * MatchCommand
+ *
+ * Returns the specified code if the command matches the name.
+ *
+ * @param Command the command
+ * @param Name the candidate's name
+ * @param Code the candidate's code
+ */
+static int MatchCommand(const char *Command, const char *Name, int Code) {
+	if (strcasecmp(Command, Name) == 0) {
+		return Code;
+	} else {
+		return COMMAND_UNKNOWN;
+	}
+}
+
+/**
+ * GetCommandKey
+ *
+ * Calculates the switch key for a command.
+ *
+ * @param Command the command
+ * @param Length the command's length
+ */
+static int GetCommandKey(const char *Command, size_t Length) {
+	return COMMAND_KEY((int)Length, toupper((unsigned char)Command[0]),
+		toupper((unsigned char)Command[Length - 1]));
+}
+
+/**
+ * GetIRCCommand
+ *
+ * Returns the irc_command_e code for an IRC command, the numeric value for
+ * numeric replies or COMMAND_UNKNOWN for other commands.
+ *
+ * @param Command the command
+ */
+int GetIRCCommand(const char *Command) {
+	size_t Length = strlen(Command);
+
+	if (Length == 3 && isdigit((unsigned char)Command[0]) &&
+			isdigit((unsigned char)Command[1]) && isdigit((unsigned char)Command[2])) {
+		return (Command[0] - '0') * 100 + (Command[1] - '0') * 10 + (Command[2] - '0');
+	}
+
+	if (Length == 0) {
+		return COMMAND_UNKNOWN;
+	}
+
+	switch (GetCommandKey(Command, Length)) {
+		case COMMAND_KEY(3, 'C', 'P'):
+			return MatchCommand(Command, "CAP", IRCCommand_Cap);
+		case COMMAND_KEY(3, 'W', 'O'):
+			return MatchCommand(Command, "WHO", IRCCommand_Who);
+		case COMMAND_KEY(4, 'I', 'N'):
+			return MatchCommand(Command, "ISON", IRCCommand_Ison);
+		case COMMAND_KEY(4, 'J', 'N'):
+			return MatchCommand(Command, "JOIN", IRCCommand_Join);
+		case COMMAND_KEY(4, 'K', 'K'):
+			return MatchCommand(Command, "KICK", IRCCommand_Kick);
+		case COMMAND_KEY(4, 'M', 'E'):
+			return MatchCommand(Command, "MODE", IRCCommand_Mode);
+		case COMMAND_KEY(4, 'N', 'K'):
+			return MatchCommand(Command, "NICK", IRCCommand_Nick);
+		case COMMAND_KEY(4, 'P', 'T'):
+			return MatchCommand(Command, "PART", IRCCommand_Part);
+		case COMMAND_KEY(4, 'P', 'S'):
+			return MatchCommand(Command, "PASS", IRCCommand_Pass);
+		case COMMAND_KEY(4, 'P', 'G'):
+			if (MatchCommand(Command, "PING", IRCCommand_Ping) != COMMAND_UNKNOWN) {
+				return IRCCommand_Ping;
+			}
+
+			return MatchCommand(Command, "PONG", IRCCommand_Pong);
+		case COMMAND_KEY(4, 'Q', 'T'):
+			return MatchCommand(Command, "QUIT", IRCCommand_Quit);
+		case COMMAND_KEY(4, 'S', 'C'):
+			return MatchCommand(Command, "SBNC", IRCCommand_Sbnc);
+		case COMMAND_KEY(4, 'U', 'R'):
+			return MatchCommand(Command, "USER", IRCCommand_User);
+		case COMMAND_KEY(5, 'E', 'R'):
+			return MatchCommand(Command, "ERROR", IRCCommand_Error);
+		case COMMAND_KEY(5, 'N', 'S'):
+			return MatchCommand(Command, "NAMES", IRCCommand_Names);
+		case COMMAND_KEY(5, 'S', 'H'):
+			return MatchCommand(Command, "SYNTH", IRCCommand_Synth);
+		case COMMAND_KEY(5, 'T', 'C'):
+			return MatchCommand(Command, "TOPIC", IRCCommand_Topic);
+		case COMMAND_KEY(5, 'W', 'S'):
+			return MatchCommand(Command, "WHOIS", IRCCommand_Whois);
+		case COMMAND_KEY(6, 'N', 'E'):
+			return MatchCommand(Command, "NOTICE", IRCCommand_Notice);
+		case COMMAND_KEY(6, 'T', 'G'):
+			return MatchCommand(Command, "TAGMSG", IRCCommand_Tagmsg);
+		case COMMAND_KEY(7, 'P', 'G'):
+			return MatchCommand(Command, "PRIVMSG", IRCCommand_Privmsg);
+		case COMMAND_KEY(7, 'V', 'N'):
+			return MatchCommand(Command, "VERSION", IRCCommand_Version);
+		case COMMAND_KEY(8, 'P', 'L'):
+			return MatchCommand(Command, "PROTOCTL", IRCCommand_Protoctl);
+		case COMMAND_KEY(8, 'U', 'T'):
+			return MatchCommand(Command, "USERHOST", IRCCommand_Userhost);
+		default:
+			return COMMAND_UNKNOWN;
+	}
+}
+
+/**
+ * GetBncCommand
+ *
+ * Returns the bnc_command_e code for one of the bouncer's built-in commands
+ * or COMMAND_UNKNOWN for other commands.
+ *
+ * @param Command the command
+ */
+int GetBncCommand(const char *Command) {
+	size_t Length = strlen(Command);
+
+	if (Length == 0) {
+		return COMMAND_UNKNOWN;
+	}
+
+	switch (GetCommandKey(Command, Length)) {
+		case COMMAND_KEY(3, 'D', 'E'):
+			return MatchCommand(Command, "die", BncCommand_Die);
+		case COMMAND_KEY(3, 'S', 'T'):
+			return MatchCommand(Command, "set", BncCommand_Set);
+		case COMMAND_KEY(3, 'W', 'O'):
+			return MatchCommand(Command, "who", BncCommand_Who);
+		case COMMAND_KEY(4, 'H', 'P'):
+			return MatchCommand(Command, "help", BncCommand_Help);
+		case COMMAND_KEY(4, 'J', 'P'):
+			return MatchCommand(Command, "jump", BncCommand_Jump);
+		case COMMAND_KEY(4, 'K', 'L'):
+			return MatchCommand(Command, "kill", BncCommand_Kill);
+		case COMMAND_KEY(4, 'R', 'D'):
+			return MatchCommand(Command, "read", BncCommand_Read);
+		case COMMAND_KEY(5, 'A', 'N'):
+			return MatchCommand(Command, "admin", BncCommand_Admin);
+		case COMMAND_KEY(5, 'E', 'E'):
+			return MatchCommand(Command, "erase", BncCommand_Erase);
+		case COMMAND_KEY(5, 'L', 'D'):
+			return MatchCommand(Command, "lsmod", BncCommand_Lsmod);
+		case COMMAND_KEY(5, 'R', 'D'):
+			return MatchCommand(Command, "rmmod", BncCommand_Rmmod);
+		case COMMAND_KEY(5, 'S', 'L'):
+			return MatchCommand(Command, "simul", BncCommand_Simul);
+		case COMMAND_KEY(5, 'U', 'T'):
+			return MatchCommand(Command, "unset", BncCommand_Unset);
+		case COMMAND_KEY(6, 'D', 'T'):
+			return MatchCommand(Command, "direct", BncCommand_Direct);
+		case COMMAND_KEY(6, 'I', 'D'):
+			return MatchCommand(Command, "insmod", BncCommand_Insmod);
+		case COMMAND_KEY(6, 'S', 'S'):
+			return MatchCommand(Command, "status", BncCommand_Status);
+		case COMMAND_KEY(7, 'A', 'R'):
+			return MatchCommand(Command, "adduser", BncCommand_Adduser);
+		case COMMAND_KEY(7, 'B', 'G'):
+			return MatchCommand(Command, "backlog", BncCommand_Backlog);
+		case COMMAND_KEY(7, 'D', 'T'):
+			return MatchCommand(Command, "delcert", BncCommand_Delcert);
+		case COMMAND_KEY(7, 'D', 'R'):
+			return MatchCommand(Command, "deluser", BncCommand_Deluser);
+		case COMMAND_KEY(7, 'I', 'E'):
+			return MatchCommand(Command, "impulse", BncCommand_Impulse);
+		case COMMAND_KEY(7, 'P', 'L'):
+			return MatchCommand(Command, "partall", BncCommand_Partall);
+		case COMMAND_KEY(7, 'S', 'D'):
+			return MatchCommand(Command, "suspend", BncCommand_Suspend);
+		case COMMAND_KEY(7, 'U', 'N'):
+			return MatchCommand(Command, "unadmin", BncCommand_Unadmin);
+		case COMMAND_KEY(8, 'S', 'T'):
+			if (MatchCommand(Command, "savecert", BncCommand_Savecert) != COMMAND_UNKNOWN) {
+				return BncCommand_Savecert;
+			}
+
+			return MatchCommand(Command, "showcert", BncCommand_Showcert);
+		case COMMAND_KEY(9, 'B', 'T'):
+			return MatchCommand(Command, "broadcast", BncCommand_Broadcast);
+		case COMMAND_KEY(9, 'G', 'T'):
+			return MatchCommand(Command, "globalset", BncCommand_Globalset);
+		case COMMAND_KEY(9, 'L', 'S'):
+			return MatchCommand(Command, "listeners", BncCommand_Listeners);
+		case COMMAND_KEY(9, 'R', 'S'):
+			return MatchCommand(Command, "resetpass", BncCommand_Resetpass);
+		case COMMAND_KEY(9, 'U', 'D'):
+			return MatchCommand(Command, "unsuspend", BncCommand_Unsuspend);
+		case COMMAND_KEY(10, 'D', 'T'):
+			return MatchCommand(Command, "disconnect", BncCommand_Disconnect);
+		case COMMAND_KEY(11, 'A', 'R'):
+			return MatchCommand(Command, "addlistener", BncCommand_Addlistener);
+		case COMMAND_KEY(11, 'D', 'R'):
+			return MatchCommand(Command, "dellistener", BncCommand_Dellistener);
+		case COMMAND_KEY(11, 'G', 'T'):
+			return MatchCommand(Command, "globalunset", BncCommand_Globalunset);
+		case COMMAND_KEY(11, 'P', 'G'):
+			return MatchCommand(Command, "playmainlog", BncCommand_Playmainlog);
+		case COMMAND_KEY(12, 'E', 'G'):
+			if (MatchCommand(Command, "erasebacklog", BncCommand_Erasebacklog) != COMMAND_UNKNOWN) {
+				return BncCommand_Erasebacklog;
+			}
+
+			return MatchCommand(Command, "erasemainlog", BncCommand_Erasemainlog);
+		default:
+			return COMMAND_UNKNOWN;
+	}
+}
@@ -0,0 +1,110 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#define COMMAND_UNKNOWN (-1) /**< returned for unknown commands */
+
+/**
+ * irc_command_e
+ *
+ * IRC commands which are handled by the bouncer. Numeric replies
+ * use their numeric value (0 - 999) instead.
+ */
+enum irc_command_e {
+	IRCCommand_Unknown = COMMAND_UNKNOWN,
+	IRCCommand_Privmsg = 1000,
+	IRCCommand_Notice,
+	IRCCommand_Join,
+	IRCCommand_Part,
+	IRCCommand_Kick,
+	IRCCommand_Nick,
+	IRCCommand_Quit,
+	IRCCommand_Mode,
+	IRCCommand_Topic,
+	IRCCommand_Pong,
+	IRCCommand_Ping,
+	IRCCommand_Error,
+	IRCCommand_Pass,
+	IRCCommand_User,
+	IRCCommand_Cap,
+	IRCCommand_Whois,
+	IRCCommand_Userhost,
+	IRCCommand_Protoctl,
+	IRCCommand_Sbnc,
+	IRCCommand_Synth,
+	IRCCommand_Names,
+	IRCCommand_Who,
+	IRCCommand_Version,
+	IRCCommand_Ison,
+	IRCCommand_Tagmsg
+};
+
+/**
+ * bnc_command_e
+ *
+ * The bouncer's built-in commands (/sbnc <command>).
+ */
+enum bnc_command_e {
+	BncCommand_Unknown = COMMAND_UNKNOWN,
+	BncCommand_Addlistener,
+	BncCommand_Adduser,
+	BncCommand_Admin,
+	BncCommand_Backlog,
+	BncCommand_Broadcast,
+	BncCommand_Delcert,
+	BncCommand_Dellistener,
+	BncCommand_Deluser,
+	BncCommand_Die,
+	BncCommand_Direct,
+	BncCommand_Disconnect,
+	BncCommand_Erase,
+	BncCommand_Erasebacklog,
+	BncCommand_Erasemainlog,
+	BncCommand_Globalset,
+	BncCommand_Globalunset,
+	BncCommand_Help,
+	BncCommand_Impulse,
+	BncCommand_Insmod,
+	BncCommand_Jump,
+	BncCommand_Kill,
+	BncCommand_Listeners,
+	BncCommand_Lsmod,
+	BncCommand_Partall,
+	BncCommand_Playmainlog,
+	BncCommand_Read,
+	BncCommand_Resetpass,
+	BncCommand_Rmmod,
+	BncCommand_Savecert,
+	BncCommand_Set,
+	BncCommand_Showcert,
+	BncCommand_Simul,
+	BncCommand_Status,
+	BncCommand_Suspend,
+	BncCommand_Unadmin,
+	BncCommand_Unset,
+	BncCommand_Unsuspend,
+	BncCommand_Who
+};
+
+int GetIRCCommand(const char *Command);
+int GetBncCommand(const char *Command);
+
+#endif /* COMMANDS_H */
@@ -21,9 +21,152 @@
 
 #define BLOCKSIZE 4096
 
+/* the maximum number of sendq segments which are sent in a single call */
+#if defined(IOV_MAX) && IOV_MAX < 64
+#	define WRITE_SEGMENTS IOV_MAX
+#else
+#	define WRITE_SEGMENTS 64
+#endif
+
+#define READ_MINSIZE 1024 /**< the minimum free space for a single read */
+#define READ_BUDGET 65536 /**< the maximum number of bytes which are read
+							from a connection per event */
+
 IMPL_DNSEVENTPROXY(CConnection, AsyncDnsFinished);
 IMPL_DNSEVENTPROXY(CConnection, AsyncBindIpDnsFinished);
 
+/**
+ * sslhandshake_t
+ *
+ * A step of an SSL handshake which is performed by a worker thread.
+ */
+typedef struct sslhandshake_s {
+	CConnection *Connection; /**< the connection (or NULL if it has been destroyed) */
+	threadwork_t *Item; /**< the thread pool's work item */
+	SSL *SSLObject; /**< the connection's SSL object */
+	SOCKET Socket; /**< the connection's socket */
+	int Result; /**< the return value of SSL_do_handshake() */
+	int Error; /**< the SSL error code */
+} sslhandshake_t;
+
+/**
+ * ConnectionQueueChanged
+ *
+ * Called when one of a connection's outbound queues has become empty
+ * or non-empty.
+ *
+ * @param Connection the connection
+ */
+void ConnectionQueueChanged(void *Connection) {
+	g_Bouncer->UpdateSocketEvents((CConnection *)Connection);
+}
+
+#ifdef HAVE_LIBSSL
+/**
+ * SSLVerifyWorker
+ *
+ * Certificate verification callback for handshakes which are performed by
+ * a worker thread. Client certificates are always accepted (just like
+ * CConnection::SSLVerify does); they are checked once the user logs in.
+ */
+static int SSLVerifyWorker(int PreVerifyOk, X509_STORE_CTX *Context) {
+	return 1;
+}
+
+/**
+ * SSLHandshakeWork
+ *
+ * Performs a handshake step on a worker thread.
+ *
+ * @param Cookie the sslhandshake_t object
+ */
+static void SSLHandshakeWork(void *Cookie) {
+	sslhandshake_t *Handshake = (sslhandshake_t *)Cookie;
+
+	ERR_clear_error();
+
+	Handshake->Result = SSL_do_handshake(Handshake->SSLObject);
+
+	if (Handshake->Result == 1) {
+		Handshake->Error = SSL_ERROR_NONE;
+	} else {
+		Handshake->Error = SSL_get_error(Handshake->SSLObject, Handshake->Result);
+	}
+
+	ERR_clear_error();
+}
+#endif /* HAVE_LIBSSL */
+
+/**
+ * SSLHandshakeDone
+ *
+ * Called by the main loop when a handshake step has been performed.
+ *
+ * @param Cookie the sslhandshake_t object
+ * @param Cancelled whether the work item was cancelled
+ */
+void SSLHandshakeDone(void *Cookie, bool Cancelled) {
+#ifdef HAVE_LIBSSL
+	sslhandshake_t *Handshake = (sslhandshake_t *)Cookie;
+
+	if (Handshake->Connection != NULL) {
+		Handshake->Connection->SSLHandshakeFinished(Handshake);
+	} else {
+		// the connection was destroyed while the worker thread was using
+		// its socket and SSL object
+		SSL_free(Handshake->SSLObject);
+
+		shutdown(Handshake->Socket, SD_BOTH);
+		closesocket(Handshake->Socket);
+	}
+
+	free(Handshake);
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * SendSegments
+ *
+ * Sends as much of a queue's data as possible using a single
+ * scatter/gather call. Returns the number of bytes which were sent.
+ *
+ * @param Socket the socket
+ * @param Queue the queue
+ */
+static int SendSegments(SOCKET Socket, CFIFOBuffer *Queue) {
+	fifosegment_t Segments[WRITE_SEGMENTS];
+	int Count;
+
+	Count = Queue->GetSegments(Segments, WRITE_SEGMENTS);
+
+#if defined(_WIN32)
+	WSABUF Buffers[WRITE_SEGMENTS];
+	DWORD Sent;
+
+	for (int i = 0; i < Count; i++) {
+		Buffers[i].buf = Segments[i].Data;
+		Buffers[i].len = Segments[i].Size;
+	}
+
+	if (WSASend(Socket, Buffers, Count, &Sent, 0, NULL, NULL) != 0) {
+		return -1;
+	}
+
+	return Sent;
+#elif defined(HAVE_WRITEV)
+	iovec Vectors[WRITE_SEGMENTS];
+
+	for (int i = 0; i < Count; i++) {
+		Vectors[i].iov_base = Segments[i].Data;
+		Vectors[i].iov_len = Segments[i].Size;
+	}
+
+	return writev(Socket, Vectors, Count);
+#else
+	return send(Socket, Segments[0].Data, Segments[0].Size, 0);
+#endif
+}
+
 /**
  * CConnection
  *
@@ -107,11 +250,15 @@ void CConnection::InitConnection(SOCKET Client, bool SSL) {
 	m_PortCache = 0;
 
 	m_LatchedDestruction = false;
+	m_DestroyLink = NULL;
 	m_Connected = false;
 
 	m_InboundTrafficReset = g_CurrentTime;
 	m_InboundTraffic = 0;
 
+	m_Handshake = NULL;
+	m_KernelTLS = -1;
+
 #ifdef HAVE_LIBSSL
 	m_HasSSL = SSL;
 	m_SSL = NULL;
@@ -129,7 +276,10 @@ void CConnection::InitConnection(SOCKET Client, bool SSL) {
 	}
 
 	m_SendQ = new CFIFOBuffer();
+	m_SendQ->SetNotifyProc(ConnectionQueueChanged, this);
+
 	m_RecvQ = new CFIFOBuffer();
+	m_ParseEol = NULL;
 }
 
 /**
@@ -139,6 +289,21 @@ void CConnection::InitConnection(SOCKET Client, bool SSL) {
  */
 CConnection::~CConnection(void) {
 	g_Bouncer->UnregisterSocket(m_Socket);
+	g_Bouncer->CancelDestroy(this);
+
+	// a worker thread is still using the socket and the SSL object,
+	// SSLHandshakeDone() takes care of them
+	if (m_Handshake != NULL) {
+		m_Handshake->Connection = NULL;
+		g_Bouncer->GetThreadPool()->Cancel(m_Handshake->Item);
+
+		m_Socket = INVALID_SOCKET;
+		m_SSL = NULL;
+	}
+
+	if (m_KernelTLS > 0) {
+		g_Bouncer->KernelTLSChanged(-1);
+	}
 
 	delete m_DnsQuery;
 	delete m_BindDnsQuery;
@@ -245,94 +410,121 @@ SOCKET CConnection::GetSocket(void) const {
  */
 int CConnection::Read(bool DontProcess) {
 	int ReadResult;
-	static char *Buffer = NULL;
-	const int BufferSize = 8192;
+	int ReturnValue = 0;
+	size_t Total = 0;
 
 	m_Connected = true;
 
-	if (m_Shutdown) {
+	if (m_Shutdown || m_Handshake != NULL || StartSSLHandshake()) {
 		return 0;
 	}
 
-	if (Buffer == NULL) {
-		Buffer = (char *)malloc(BufferSize);
+	if (m_KernelTLS == -1) {
+		UpdateKernelTLS();
 	}
 
-	if (AllocFailed(Buffer)) {
-		return -1;
-	}
+	/* Data is received directly into the recvq. The socket is drained until
+	 * a read returns less data than there was space for, or until the
+	 * connection has used up its budget for this event. */
+	while (Total < READ_BUDGET) {
+		char *Buffer;
+		size_t Size;
+		bool Pending = false;
+
+		Buffer = m_RecvQ->Reserve(READ_MINSIZE, &Size);
+
+		if (Buffer == NULL) {
+			return -1;
+		}
+
+		if (Size > READ_BUDGET - Total) {
+			Size = READ_BUDGET - Total;
+		}
 
 #ifdef HAVE_LIBSSL
-	if (IsSSL()) {
-		ReadResult = SSL_read(m_SSL, Buffer, BufferSize);
-
-		if (ReadResult < 0) {
-			switch (SSL_get_error(m_SSL, ReadResult)) {
-				case SSL_ERROR_WANT_WRITE:
-				case SSL_ERROR_WANT_READ:
-				case SSL_ERROR_NONE:
-				case SSL_ERROR_ZERO_RETURN:
-
-					return 0;
-				default:
-					return -1;
+		if (IsSSL()) {
+			ReadResult = SSL_read(m_SSL, Buffer, Size);
+
+			if (ReadResult < 0) {
+				switch (SSL_get_error(m_SSL, ReadResult)) {
+					case SSL_ERROR_WANT_WRITE:
+					case SSL_ERROR_WANT_READ:
+					case SSL_ERROR_NONE:
+					case SSL_ERROR_ZERO_RETURN:
+
+						break;
+					default:
+						return -1;
+				}
+
+				break;
 			}
-		}
 
-		ERR_print_errors_fp(stdout);
-	} else {
+			ERR_print_errors_fp(stdout);
+
+			Pending = (SSL_pending(m_SSL) > 0);
+		} else {
 #endif
-		ReadResult = recv(m_Socket, Buffer, BufferSize, 0);
+			ReadResult = recv(m_Socket, Buffer, Size, 0);
 #ifdef HAVE_LIBSSL
-	}
+		}
 #endif
 
-	if (ReadResult > 0) {
-		if (g_CurrentTime - m_InboundTrafficReset > 30) {
-			m_InboundTrafficReset = g_CurrentTime;
-			m_InboundTraffic = 0;
-		}
+		if (ReadResult > 0) {
+			if (g_CurrentTime - m_InboundTrafficReset > 30) {
+				m_InboundTrafficReset = g_CurrentTime;
+				m_InboundTraffic = 0;
+			}
 
-		m_InboundTraffic += ReadResult;
+			m_InboundTraffic += ReadResult;
 
-		m_RecvQ->Write(Buffer, ReadResult);
+			m_RecvQ->Commit(ReadResult);
 
-		if (m_Traffic) {
-			m_Traffic->AddInbound(ReadResult);
-		}
-	} else {
-		int ErrorCode;
+			if (m_Traffic) {
+				m_Traffic->AddInbound(ReadResult);
+			}
 
-		if (ReadResult == 0) {
-			return -1;
-		}
+			Total += ReadResult;
 
-		ErrorCode = errno;
+			if ((size_t)ReadResult < Size && !Pending) {
+				break;
+			}
+		} else {
+			int ErrorCode;
+
+			if (ReadResult == 0) {
+				ReturnValue = -1;
+
+				break;
+			}
+
+			ErrorCode = errno;
 
 #ifdef _WIN32
-		if (ErrorCode == WSAEWOULDBLOCK) {
-			return 0;
-		}
+			if (ErrorCode == WSAEWOULDBLOCK) {
+				break;
+			}
 #else
-		if (ErrorCode == EAGAIN) {
-			return 0;
-		}
+			if (ErrorCode == EAGAIN) {
+				break;
+			}
 #endif
 
 #ifdef HAVE_LIBSSL
-		if (IsSSL()) {
-			SSL_shutdown(m_SSL);
-		}
+			if (IsSSL()) {
+				SSL_shutdown(m_SSL);
+			}
 #endif
 
-		return ErrorCode;
+			return ErrorCode;
+		}
 	}
 
-	if (!DontProcess) {
+	if (Total > 0 && !DontProcess) {
 		ProcessBuffer();
 	}
 
-	return 0;
+	return ReturnValue;
 }
 
 /**
@@ -341,17 +533,30 @@ int CConnection::Read(bool DontProcess) {
  * Called when data can be written for the socket.
  */
 int CConnection::Write(void) {
-	size_t Size;
 	int ReturnValue = 0;
 
-	Size = m_SendQ->GetSize();
+	if (m_Handshake != NULL || StartSSLHandshake()) {
+		return 0;
+	}
+
+	if (m_KernelTLS == -1) {
+		UpdateKernelTLS();
+	}
 
-	if (Size > 0) {
+	if (m_SendQ->GetSize() > 0) {
 		int WriteResult;
 
 #ifdef HAVE_LIBSSL
-		if (IsSSL()) {
-			WriteResult = SSL_write(m_SSL, m_SendQ->Peek(), Size);
+		// the kernel encrypts the data if kernel TLS is enabled for sending,
+		// so the sendq can be written directly (unless OpenSSL still has
+		// to flush a record of its own)
+		if (IsSSL() && (!(m_KernelTLS > 0 && (m_KernelTLS & KernelTLS_Send)) || SSL_want_write(m_SSL))) {
+			char *Buffer;
+			size_t Size;
+
+			Buffer = m_SendQ->PeekSegment(&Size);
+
+			WriteResult = SSL_write(m_SSL, Buffer, Size);
 
 			if (WriteResult == -1) {
 				switch (SSL_get_error(m_SSL, WriteResult)) {
@@ -364,7 +569,7 @@ int CConnection::Write(void) {
 			}
 		} else {
 #endif
-			WriteResult = send(m_Socket, m_SendQ->Peek(), Size, 0);
+			WriteResult = SendSegments(m_Socket, m_SendQ);
 #ifdef HAVE_LIBSSL
 		}
 #endif
@@ -389,9 +594,11 @@ int CConnection::Write(void) {
 		}
 #endif
 
+		// the socket is closed by the destructor; shutting it down makes
+		// the main loop report a hangup for the socket which then destroys
+		// the connection object
 		if (m_Socket != INVALID_SOCKET) {
 			shutdown(m_Socket, SD_BOTH);
-			closesocket(m_Socket);
 		}
 	}
 
@@ -401,38 +608,84 @@ int CConnection::Write(void) {
 /**
  * ProcessBuffer
  *
- * Processes the data which is in the recvq.
+ * Processes the data which is in the recvq. Lines are terminated in place
+ * and passed to ParseLine() without being copied (unless they span more
+ * than one of the recvq's chunks).
  */
 void CConnection::ProcessBuffer(void) {
-	char *RecvQ, *Line;
-	size_t Size;
-	
-	Line = RecvQ = m_RecvQ->Peek();
+	CFIFOBuffer *RecvQ = m_RecvQ;
+	char *Line, *Eol, *Next;
+	size_t Size, Offset;
 
-	Size = m_RecvQ->GetSize();
+	while ((Line = RecvQ->PeekSegment(&Size)) != NULL) {
+		Eol = (char *)memchr(Line, '\n', Size);
 
-	for (unsigned int i = 0; i < Size; i++) {
-		if (RecvQ[i] == '\n' || (RecvQ[i] == '\r' && Size > i + 1 && RecvQ[i + 1] == '\n')) {
-			char *dupLine = (char *)malloc(&(RecvQ[i]) - Line + 1);
+		if (Eol == NULL) {
+			if (Size == RecvQ->GetSize() || !RecvQ->Find('\n', &Offset)) {
+				break;
+			}
+
+			Line = RecvQ->Linearize(Offset + 1);
+			Eol = Line + Offset;
+		}
+
+		Next = Eol + 1;
+
+		if (Eol > Line && *(Eol - 1) == '\r') {
+			Eol--;
+		}
+
+		m_ParseEol = Eol;
+		m_ParseTerminator = *Eol;
+		*Eol = '\0';
+
+		if (Line[0] != '\0') {
+			ParseLine(Line);
+
+			// the recvq might have been detached (e.g. by
+			// CClientConnection::Hijack), in which case its new owner got
+			// a copy of it
+			if (m_RecvQ != RecvQ) {
+				delete RecvQ;
 
-			if (AllocFailed(dupLine)) {
 				return;
 			}
+		}
 
-			memcpy(dupLine, Line, &(RecvQ[i]) - Line);
-			dupLine[&(RecvQ[i]) - Line] = '\0';
+		m_ParseEol = NULL;
 
-			if (dupLine[0] != '\0') {
- 				ParseLine(dupLine);
-			}
+		RecvQ->Read(Next - Line);
+	}
+}
+
+/**
+ * DetachRecvQ
+ *
+ * Detaches the recvq from the connection and returns it. The connection
+ * gets a new, empty recvq. While ProcessBuffer() is parsing a line the
+ * recvq is still in use, so a copy of it (with the line's terminator
+ * restored) is returned instead.
+ */
+CFIFOBuffer *CConnection::DetachRecvQ(void) {
+	CFIFOBuffer *RecvQ = m_RecvQ;
 
-			free(dupLine);
+	if (m_ParseEol != NULL) {
+		RecvQ = new CFIFOBuffer();
 
-			Line = &RecvQ[i + 1];
+		*m_ParseEol = m_ParseTerminator;
+
+		if (IsError(RecvQ->Write(m_RecvQ))) {
+			g_Bouncer->Log("Could not copy the recvq for a detached connection.");
 		}
+
+		*m_ParseEol = '\0';
+
+		m_ParseEol = NULL;
 	}
 
-	m_RecvQ->Read(Line - RecvQ);
+	m_RecvQ = new CFIFOBuffer();
+
+	return RecvQ;
 }
 
 /**
@@ -444,49 +697,37 @@ void CConnection::ProcessBuffer(void) {
  * @param Out points to the line
  */
 bool CConnection::ReadLine(char **Out) {
-	char *old_recvq;
-	size_t Size;
-	char *Pos = NULL;
-	bool advance = false;
+	char *RecvQ, *Eol, *Next;
+	size_t Length, Offset;
 
-	old_recvq = m_RecvQ->Peek();
+	*Out = NULL;
 
-	if (old_recvq == NULL) {
+	if (!m_RecvQ->Find('\n', &Offset)) {
 		return false;
 	}
 
-	Size = m_RecvQ->GetSize();
-
-	for (unsigned int i = 0; i < Size; i++) {
-		if (old_recvq[i] == '\n' || (Size > i + 1 && old_recvq[i] == '\r' && old_recvq[i + 1] == '\n')) {
-			if (old_recvq[i] == '\r') {
-				advance = true;
-			}
+	RecvQ = m_RecvQ->Linearize(Offset + 1);
+	Eol = RecvQ + Offset;
+	Next = Eol + 1;
 
-			Pos = old_recvq + i;
-			break;
-		}
+	if (Eol > RecvQ && *(Eol - 1) == '\r') {
+		Eol--;
 	}
 
-	if (Pos != NULL) {
-		size_t Size;
-		*Pos = '\0';
-		char *NewPtr = Pos + 1 + (advance ? 1 : 0);
-
-		Size = NewPtr - old_recvq + 1;
-		*Out = (char *)malloc(Size);
-
-		if (AllocFailed(*Out)) {
-			return false;
-		}
+	Length = Eol - RecvQ;
 
-		strmcpy(*Out, m_RecvQ->Read(NewPtr - old_recvq), Size);
+	*Out = (char *)malloc(Length + 1);
 
-		return true;
-	} else {
-		*Out = NULL;
+	if (AllocFailed(*Out)) {
 		return false;
 	}
+
+	memcpy(*Out, RecvQ, Length);
+	(*Out)[Length] = '\0';
+
+	m_RecvQ->Read(Next - RecvQ);
+
+	return true;
 }
 
 /**
@@ -500,6 +741,17 @@ void CConnection::WriteUnformattedLine(const char *Line) {
 	m_SendQ->WriteUnformattedLine(Line);
 }
 
+/**
+ * WriteSharedLine
+ *
+ * Writes a shared line for the connection without copying it.
+ *
+ * @param Line the line
+ */
+void CConnection::WriteSharedLine(CSharedLine *Line) {
+	m_SendQ->WriteSharedLine(Line);
+}
+
 /**
  * WriteLine
  *
@@ -585,6 +837,10 @@ void CConnection::Kill(const char *Error) {
  * written to the socket.
  */
 bool CConnection::HasQueuedData(void) const {
+	if (m_Handshake != NULL) {
+		return false;
+	}
+
 #ifdef HAVE_LIBSSL
 	if (IsSSL()) {
 		if (SSL_want_write(m_SSL)) {
@@ -600,6 +856,111 @@ bool CConnection::HasQueuedData(void) const {
 	return m_SendQ->GetSize() > 0;
 }
 
+/**
+ * StartSSLHandshake
+ *
+ * Passes the next step of the SSL handshake for an incoming connection to
+ * a worker thread (if worker threads are enabled). The socket is not
+ * watched by the main loop until the worker thread has finished. Returns
+ * true if the handshake step was started.
+ */
+bool CConnection::StartSSLHandshake(void) {
+#ifdef HAVE_LIBSSL
+	CThreadPool *Pool = g_Bouncer->GetThreadPool();
+	sslhandshake_t *Handshake;
+	threadwork_t *Item;
+
+	if (m_Shutdown || Pool == NULL || Pool->GetThreadCount() == 0 || !IsSSL() || m_SSL == NULL ||
+			GetRole() != Role_Server || SSL_is_init_finished(m_SSL)) {
+		return false;
+	}
+
+	Handshake = (sslhandshake_t *)malloc(sizeof(sslhandshake_t));
+
+	if (AllocFailed(Handshake)) {
+		return false;
+	}
+
+	Handshake->Connection = this;
+	Handshake->Item = NULL;
+	Handshake->SSLObject = m_SSL;
+	Handshake->Socket = m_Socket;
+	Handshake->Result = -1;
+	Handshake->Error = SSL_ERROR_WANT_READ;
+
+	// the worker thread must not use the connection object
+	SSL_set_ex_data(m_SSL, g_Bouncer->GetSSLCustomIndex(), NULL);
+	SSL_set_verify(m_SSL, SSL_get_verify_mode(m_SSL), SSLVerifyWorker);
+
+	g_Bouncer->UnregisterSocket(m_Socket);
+
+	m_Handshake = Handshake;
+
+	Item = Pool->Queue(SSLHandshakeWork, SSLHandshakeDone, Handshake);
+
+	// Queue() returns NULL if the handshake step has already been performed
+	if (Item != NULL) {
+		Handshake->Item = Item;
+	}
+
+	return true;
+#else /* HAVE_LIBSSL */
+	return false;
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * SSLHandshakeFinished
+ *
+ * Called when a worker thread has performed a handshake step.
+ *
+ * @param Handshake the handshake
+ */
+void CConnection::SSLHandshakeFinished(sslhandshake_t *Handshake) {
+#ifdef HAVE_LIBSSL
+	int Code = 0;
+
+	// Queue() performs the handshake step right away if it can't pass it
+	// on to a worker thread, in which case StartSSLHandshake() and its
+	// caller are still using the connection object
+	bool Synchronous = (Handshake->Item == NULL);
+
+	m_Handshake = NULL;
+
+	SSL_set_ex_data(m_SSL, g_Bouncer->GetSSLCustomIndex(), this);
+
+	g_Bouncer->RegisterSocket(m_Socket, (CSocketEvents *)this);
+
+	switch (Handshake->Error) {
+		case SSL_ERROR_NONE:
+			// the client might have sent data along with its last handshake
+			// message, which OpenSSL has already read from the socket
+			if (SSL_has_pending(m_SSL)) {
+				Code = Read();
+			}
+
+			break;
+		case SSL_ERROR_WANT_READ:
+		case SSL_ERROR_WANT_WRITE:
+			break;
+		default:
+			Code = -1;
+	}
+
+	if (Code != 0) {
+		Error(Code);
+
+		if (Synchronous) {
+			// the main loop destroys the connection once the caller is done
+			Shutdown();
+			LatchDestruction();
+		} else {
+			Destroy();
+		}
+	}
+#endif /* HAVE_LIBSSL */
+}
+
 /**
  * GetSendqSize
  *
@@ -644,6 +1005,8 @@ void CConnection::Destroy(void) {
  */
 void CConnection::Shutdown(void) {
 	m_Shutdown = true;
+
+	g_Bouncer->ScheduleDestroy(this);
 }
 
 /**
@@ -655,6 +1018,19 @@ void CConnection::Shutdown(void) {
  */
 void CConnection::Timeout(int TimeLeft) {
 	m_Timeout = g_CurrentTime + TimeLeft;
+
+	g_Bouncer->ScheduleDestroy(this);
+}
+
+/**
+ * LatchDestruction
+ *
+ * Marks the connection object so that it is destroyed by the main loop.
+ */
+void CConnection::LatchDestruction(void) {
+	m_LatchedDestruction = true;
+
+	g_Bouncer->ScheduleDestroy(this);
 }
 
 /**
@@ -723,6 +1099,58 @@ const X509 *CConnection::GetPeerCertificate(void) const {
 	return NULL;
 }
 
+/**
+ * UpdateKernelTLS
+ *
+ * Checks whether OpenSSL has passed the connection's encryption to the
+ * kernel once the handshake has finished (see system.ktls).
+ */
+void CConnection::UpdateKernelTLS(void) {
+#ifdef HAVE_LIBSSL
+	if (!IsSSL()) {
+		m_KernelTLS = KernelTLS_None;
+
+		return;
+	}
+
+	if (m_SSL == NULL || !SSL_is_init_finished(m_SSL)) {
+		return;
+	}
+
+	m_KernelTLS = KernelTLS_None;
+
+#	ifdef SSL_OP_ENABLE_KTLS
+	if (BIO_get_ktls_send(SSL_get_wbio(m_SSL))) {
+		m_KernelTLS |= KernelTLS_Send;
+	}
+
+	if (BIO_get_ktls_recv(SSL_get_rbio(m_SSL))) {
+		m_KernelTLS |= KernelTLS_Recv;
+	}
+#	endif /* SSL_OP_ENABLE_KTLS */
+
+	if (m_KernelTLS > 0) {
+		g_Bouncer->KernelTLSChanged(1);
+	}
+#else /* HAVE_LIBSSL */
+	m_KernelTLS = KernelTLS_None;
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * GetKernelTLS
+ *
+ * Returns which directions of the connection are encrypted by the
+ * kernel (a combination of kernel_tls_e flags).
+ */
+int CConnection::GetKernelTLS(void) const {
+	if (m_KernelTLS == -1) {
+		return KernelTLS_None;
+	}
+
+	return m_KernelTLS;
+}
+
 /**
  * SSLVerify
  *
@@ -798,7 +1226,7 @@ void CConnection::AsyncConnect(void) {
 
 			Error(ErrorCode);
 
-			m_LatchedDestruction = true;
+			LatchDestruction();
 		} else {
 			InitSocket();
 		}
@@ -817,7 +1245,7 @@ void CConnection::AsyncDnsFinished(hostent *Response) {
 		// we cannot destroy the object here as there might still be the other
 		// dns query (bind ip) in the queue which would get destroyed in the
 		// destructor; this causes a crash in the StartMainLoop() function
-		m_LatchedDestruction = true;
+		LatchDestruction();
 
 		return;
 	 }
@@ -827,7 +1255,7 @@ void CConnection::AsyncDnsFinished(hostent *Response) {
 	m_HostAddr = malloc(Size);
 
 	if (AllocFailed(m_HostAddr)) {
-		m_LatchedDestruction = true;
+		LatchDestruction();
 		return;
 	}
 
@@ -949,6 +1377,10 @@ void CConnection::SetSendQ(CFIFOBuffer *Buffer) {
 	if (m_SendQ == NULL) {
 		m_SendQ = new CFIFOBuffer();
 	}
+
+	m_SendQ->SetNotifyProc(ConnectionQueueChanged, this);
+
+	g_Bouncer->UpdateSocketEvents(this);
 }
 
 /**
@@ -988,5 +1420,11 @@ void CConnection::SetSSLObject(void *SSLObject) {
 	}
 
 	m_SSL = (SSL *)SSLObject;
+
+	if (m_KernelTLS > 0) {
+		g_Bouncer->KernelTLSChanged(-1);
+	}
+
+	m_KernelTLS = -1;
 #endif
 }
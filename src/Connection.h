@@ -23,6 +23,11 @@
 class CUser;
 class CTrafficStats;
 class CFIFOBuffer;
+struct sslhandshake_s;
+
+#ifndef SWIG
+void ConnectionQueueChanged(void *Connection);
+#endif /* SWIG */
 
 /**
  * connection_role_e
@@ -35,6 +40,17 @@ enum connection_role_e {
 	Role_Client
 };
 
+/**
+ * kernel_tls_e
+ *
+ * The directions of a TLS connection which are handled by the kernel.
+ */
+enum kernel_tls_e {
+	KernelTLS_None = 0,
+	KernelTLS_Send = 1,
+	KernelTLS_Recv = 2
+};
+
 /**
  * CConnection
  *
@@ -44,17 +60,21 @@ class SBNCAPI CConnection : public CSocketEvents {
 #ifndef SWIG
 	friend class CCore;
 	friend class CUser;
+
+	friend void SSLHandshakeDone(void *Cookie, bool Cancelled);
 #endif /* SWIG */
 protected:
 	virtual void ParseLine(const char *Line);
 
 	void Timeout(int TimeLeft);
+	void LatchDestruction(void);
 
 	void SetRole(connection_role_e Role);
 
 	void InitSocket(void);
 
 	void ProcessBuffer(void);
+	CFIFOBuffer *DetachRecvQ(void);
 
 	void AsyncConnect(void);
 
@@ -63,11 +83,19 @@ protected:
 
 	bool m_HasSSL; /**< is this an ssl-enabled connection? */
 	SSL *m_SSL; /**< SSL context for this connection */
+	struct sslhandshake_s *m_Handshake; /**< the handshake which is currently
+										being performed by a worker thread */
 
 	CFIFOBuffer *m_SendQ; /**< send queue */
 	CFIFOBuffer *m_RecvQ; /**< receive queue */
+	char *m_ParseEol; /**< the end of the line which ProcessBuffer() is
+					currently parsing (or NULL) */
+	char m_ParseTerminator; /**< the character which was replaced with '\0'
+							at the end of that line */
 
 	bool m_LatchedDestruction; /**< should the connection object be destroyed? */
+	link_t<CConnection *> *m_DestroyLink; /**< link in the core's list of connections
+											which might have to be destroyed */
 
 public:
 	virtual void AsyncDnsFinished(hostent *Response);
@@ -94,8 +122,15 @@ private:
 	time_t m_InboundTrafficReset; /**< when the inbound traffic was last reset */
 	size_t m_InboundTraffic; /**< inbound traffic (in bytes) since last reset */
 
+	int m_KernelTLS; /**< kernel_tls_e flags (or -1 if the handshake hasn't
+					 finished yet) */
+
 	void InitConnection(SOCKET Client, bool SSL);
 
+	bool StartSSLHandshake(void);
+	void SSLHandshakeFinished(struct sslhandshake_s *Handshake);
+	void UpdateKernelTLS(void);
+
 	virtual const char *GetClassName(void) const;
 public:
 #ifndef SWIG
@@ -110,6 +145,9 @@ public:
 	virtual void WriteUnformattedLine(const char *Line);
 	virtual void WriteLine(const char *Format, ...);
 	virtual bool ReadLine(char **Out);
+#ifndef SWIG
+	virtual void WriteSharedLine(CSharedLine *Line);
+#endif /* SWIG */
 
 	connection_role_e GetRole(void) const;
 
@@ -128,6 +166,7 @@ public:
 	bool IsSSL(void) const;
 	const X509 *GetPeerCertificate(void) const;
 	virtual int SSLVerify(int PreVerifyOk, X509_STORE_CTX *Context) const;
+	int GetKernelTLS(void) const;
 
 	sockaddr *GetRemoteAddress(void) const;
 	sockaddr *GetLocalAddress(void) const;
@@ -22,6 +22,7 @@
 const char *g_ErrorFile; /**< name of the file where the last error occured */
 unsigned int g_ErrorLine; /**< line where the last error occurred */
 time_t g_CurrentTime; /**< current time (updated in main loop) */
+mtime_t g_MonotonicTime; /**< current monotonic time in milliseconds (updated in main loop) */
 
 #ifdef HAVE_LIBSSL
 int SSLVerifyCertificate(int preverify_ok, X509_STORE_CTX *x509ctx);
@@ -73,8 +74,6 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 	rename(SourcePath, BuildPathLog("sbnc.log.old"));
 	free(SourcePath);
 
-	m_PollFds.Preallocate(SFD_SETSIZE);
-
 	m_Log = new CLog("sbnc.log", true);
 
 	if (m_Log == NULL) {
@@ -88,6 +87,16 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 
 	g_Bouncer = this;
 
+	m_ThreadPool = NULL;
+	m_KernelTLSConnections = 0;
+	m_SSLTicketKeys = NULL;
+
+	m_Sockets = new CSocketTable(SFD_SETSIZE);
+
+	if (AllocFailed(m_Sockets)) {
+		Fatal();
+	}
+
 	m_Config = Config;
 
 	m_Args.SetList(argv, argc);
@@ -97,6 +106,14 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 	m_Config = new CConfig("sbnc.conf", NULL);
 	CacheInitialize(m_ConfigCache, m_Config, "system.");
 
+	m_EventBackend = CEventBackend::Create(m_Config->ReadString("system.eventbackend"), m_Sockets);
+
+	if (AllocFailed(m_EventBackend)) {
+		Fatal();
+	}
+
+	Log("Using event backend: %s", m_EventBackend->GetName());
+
 	const char *Users;
 	CUser *User;
 
@@ -151,6 +168,7 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 	m_Capabilities = new CVector<const char *>();
 	m_Capabilities->Insert("multi-prefix");
 	m_Capabilities->Insert("znc.in/server-time-iso");
+	m_Capabilities->Insert("message-tags");
 }
 
 /**
@@ -161,6 +179,15 @@ CCore::CCore(CConfig *Config, int argc, char **argv) {
 CCore::~CCore(void) {
 	int a, i;
 
+	delete m_ThreadPool;
+	m_ThreadPool = NULL;
+
+#ifdef HAVE_LIBSSL
+	// worker threads might have used the ticket keys
+	delete m_SSLTicketKeys;
+	m_SSLTicketKeys = NULL;
+#endif /* HAVE_LIBSSL */
+
 	for (a = m_Modules.GetLength() - 1; a >= 0; a--) {
 		delete m_Modules[a];
 	}
@@ -169,9 +196,11 @@ CCore::~CCore(void) {
 
 	UninitializeAdditionalListeners();
 
-	for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
-		if (SocketCursor->PollFd->fd != INVALID_SOCKET) {
-			SocketCursor->Events->Destroy();
+	for (i = 0; i < m_Sockets->GetSlotCount(); i++) {
+		socket_t *Socket = m_Sockets->GetSlot(i);
+
+		if (Socket->PollFd->fd != INVALID_SOCKET) {
+			Socket->Events->Destroy();
 		}
 	}
 
@@ -182,6 +211,12 @@ CCore::~CCore(void) {
 
 	CTimer::DestroyAllTimers();
 
+	delete m_EventBackend;
+	m_EventBackend = NULL;
+
+	delete m_Sockets;
+	m_Sockets = NULL;
+
 	delete m_Log;
 	delete m_Ident;
 
@@ -201,6 +236,7 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	unsigned int i;
 
 	time(&g_CurrentTime);
+	g_MonotonicTime = GetMonotonicTime();
 
 	int Port = CacheGetInteger(m_ConfigCache, port);
 #ifdef HAVE_LIBSSL
@@ -214,10 +250,11 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	}
 
 	const char *BindIp = CacheGetString(m_ConfigCache, ip);
+	int Sockets = GetListenerSockets();
 
 	if (m_Listener == NULL) {
 		if (Port != 0) {
-			m_Listener = new CClientListener(Port, BindIp, AF_INET);
+			m_Listener = new CClientListener(Port, BindIp, AF_INET, false, Sockets);
 		} else {
 			m_Listener = NULL;
 		}
@@ -225,7 +262,7 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 
 	if (m_ListenerV6 == NULL) {
 		if (Port != 0) {
-			m_ListenerV6 = new CClientListener(Port, BindIp, AF_INET6);
+			m_ListenerV6 = new CClientListener(Port, BindIp, AF_INET6, false, Sockets);
 
 			if (m_ListenerV6->IsValid() == false) {
 				delete m_ListenerV6;
@@ -240,7 +277,7 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 #ifdef HAVE_LIBSSL
 	if (m_SSLListener == NULL) {
 		if (SSLPort != 0) {
-			m_SSLListener = new CClientListener(SSLPort, BindIp, AF_INET, true);
+			m_SSLListener = new CClientListener(SSLPort, BindIp, AF_INET, true, Sockets);
 		} else {
 			m_SSLListener = NULL;
 		}
@@ -248,7 +285,7 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 
 	if (m_SSLListenerV6 == NULL) {
 		if (SSLPort != 0) {
-			m_SSLListenerV6 = new CClientListener(SSLPort, BindIp, AF_INET6, true);
+			m_SSLListenerV6 = new CClientListener(SSLPort, BindIp, AF_INET6, true, Sockets);
 
 			if (m_SSLListenerV6->IsValid() == false) {
 				delete m_SSLListenerV6;
@@ -274,6 +311,17 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	SSL_CTX_set_mode(m_SSLContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 	SSL_CTX_set_mode(m_SSLClientContext, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
+	if (m_Config->ReadInteger("system.ktls") != 0) {
+#ifdef SSL_OP_ENABLE_KTLS
+		// OpenSSL falls back to user-space encryption if the kernel
+		// doesn't support TLS or the negotiated cipher
+		SSL_CTX_set_options(m_SSLContext, SSL_OP_ENABLE_KTLS);
+		SSL_CTX_set_options(m_SSLClientContext, SSL_OP_ENABLE_KTLS);
+#else /* SSL_OP_ENABLE_KTLS */
+		Log("Kernel TLS is not supported by this version of OpenSSL.");
+#endif /* SSL_OP_ENABLE_KTLS */
+	}
+
 	g_SSLCustomIndex = SSL_get_ex_new_index(0, (void *)"CConnection*", NULL, NULL, NULL);
 
 	if (!SSL_CTX_use_PrivateKey_file(m_SSLContext, BuildPathConfig("sbnc.key"), SSL_FILETYPE_PEM)) {
@@ -301,10 +349,18 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	} else {
 		SSL_CTX_set_verify(m_SSLClientContext, SSL_VERIFY_PEER, SSLVerifyCertificate);
 	}
+
+	if (m_SSLContext != NULL) {
+		InitializeSSLSessions();
+	}
 #endif
 
 	if (Port != 0 && m_Listener != NULL && m_Listener->IsValid()) {
-		Log("Created main listener.");
+		if (m_Listener->GetSocketCount() > 1) {
+			Log("Created main listener (%d sockets).", m_Listener->GetSocketCount());
+		} else {
+			Log("Created main listener.");
+		}
 	} else if (Port != 0) {
 		Log("Could not create listener port");
 		return;
@@ -312,7 +368,11 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 
 #ifdef HAVE_LIBSSL
 	if (SSLPort != 0 && m_SSLListener != NULL && m_SSLListener->IsValid()) {
-		Log("Created ssl listener.");
+		if (m_SSLListener->GetSocketCount() > 1) {
+			Log("Created ssl listener (%d sockets).", m_SSLListener->GetSocketCount());
+		} else {
+			Log("Created ssl listener.");
+		}
 	} else if (SSLPort != 0) {
 		Log("Could not create ssl listener port");
 		return;
@@ -339,6 +399,19 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 #endif
 	}
 
+	/* worker threads don't survive fork(), so the thread pool is created after daemonizing */
+	int Threads = m_Config->ReadInteger("system.threads");
+
+	if (Threads > 0) {
+		m_ThreadPool = new CThreadPool(Threads);
+
+		if (AllocFailed(m_ThreadPool)) {
+			Fatal();
+		}
+
+		Log("Started %d worker threads.", m_ThreadPool->GetThreadCount());
+	}
+
 	/* Note: We need to load the modules after using fork() as otherwise tcl cannot be cleanly unloaded */
 	m_LoadingModules = true;
 
@@ -379,10 +452,10 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 
 	int m_ShutdownLoop = 5;
 
-	time_t Last = 0;
-
 	while (GetStatus() == Status_Running || --m_ShutdownLoop) {
-		time_t Now, Best = 0, SleepInterval = 0;
+		time_t Now;
+		mtime_t Next;
+		int Timeout;
 
 #if defined(_WIN32) && defined(_DEBUG)
 		DWORD TickCount = GetTickCount();
@@ -390,20 +463,15 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 
 		time(&Now);
 
-		i = 0;
-		while (hash_t<CUser *> *UserHash = m_Users.Iterate(i++)) {
-			CIRCConnection *IRC;
+		if (GetStatus() != Status_Running) {
+			for (CHashtable<CUser *, false>::Cursor UserCursor(&m_Users); UserCursor.IsValid(); UserCursor.Proceed()) {
+				CIRCConnection *IRC;
 
-			if ((IRC = UserHash->Value->GetIRCConnection()) != NULL) {
-				if (GetStatus() != Status_Running) {
-					Log("Closing connection for user %s", UserHash->Name);
+				if ((IRC = UserCursor->Value->GetIRCConnection()) != NULL) {
+					Log("Closing connection for user %s", UserCursor->Name);
 					IRC->Kill("Shutting down.");
 
-					UserHash->Value->SetIRCConnection(NULL);
-				}
-
-				if (IRC->ShouldDestroy()) {
-					IRC->Destroy();
+					UserCursor->Value->SetIRCConnection(NULL);
 				}
 			}
 		}
@@ -417,40 +485,29 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 		}
 
 		g_CurrentTime = Now;
+		g_MonotonicTime = GetMonotonicTime();
 
-		Best = CTimer::GetNextCall();
-
-		if (Best <= g_CurrentTime) {
-#ifdef _DEBUG
-			if (g_CurrentTime - 1 > Best) {
-#else
-			if (g_CurrentTime - 5 > Best) {
-#endif
-				Log("Time warp detected: %d seconds", g_CurrentTime - Best);
-			}
-
+		// timers use the monotonic clock, so changes to the system time
+		// don't affect them
+		if (CTimer::GetNextCallMonotonic() <= g_MonotonicTime) {
 			CTimer::CallTimers();
-
-			Best = CTimer::GetNextCall();
 		}
 
-		SleepInterval = Best - g_CurrentTime;
-
 		DnsSocketCookie *DnsCookie = CDnsQuery::RegisterSockets();
 
-		for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
-			if (SocketCursor->PollFd->fd == INVALID_SOCKET) {
-				continue;
-			}
+		DestroyPendingConnections();
 
-			if (SocketCursor->Events->ShouldDestroy()) {
-				SocketCursor->Events->Destroy();
-			} else {
-				SocketCursor->PollFd->events = POLLIN | POLLERR;
+		// only sockets whose send queues have changed need to be checked
+		while (socket_t *Socket = m_Sockets->TakeDirtySocket()) {
+			short Events = POLLIN | POLLERR;
 
-				if (SocketCursor->Events->HasQueuedData()) {
-					SocketCursor->PollFd->events |= POLLOUT;
-				}
+			if (Socket->Events->HasQueuedData()) {
+				Events |= POLLOUT;
+			}
+
+			if (Socket->PollFd->events != Events) {
+				Socket->PollFd->events = Events;
+				m_EventBackend->UpdateSocket(Socket);
 			}
 		}
 
@@ -462,121 +519,169 @@ void CCore::StartMainLoop(bool ShouldDaemonize) {
 	                }
 	        }
 
-		if (SleepInterval <= 0 || GetStatus() != Status_Running || ModulesBusy) {
-			SleepInterval = 1;
-		}
+		Next = CTimer::GetNextCallMonotonic();
 
-		if (GetStatus() != Status_Running && SleepInterval > 3) {
-			SleepInterval = 3;
+		if (Next <= g_MonotonicTime) {
+			Timeout = 0;
+		} else if (Next - g_MonotonicTime > 120 * 1000) {
+			Timeout = 120 * 1000;
+		} else {
+			Timeout = (int)(Next - g_MonotonicTime);
 		}
 
-		timeval interval = { (long)SleepInterval, 0 };
+		if (ModulesBusy && Timeout > MAINLOOP_BUSY_TIMEOUT) {
+			Timeout = MAINLOOP_BUSY_TIMEOUT;
+		}
 
-		time(&Last);
+		if (GetStatus() != Status_Running) {
+			Timeout = 1000;
+		}
 
 #ifdef _DEBUG
-		//printf("poll: %d seconds\n", SleepInterval);
+		//printf("poll: %d msecs\n", Timeout);
 #endif
 
 #if defined(_WIN32) && defined(_DEBUG)
 		DWORD TimeDiff = GetTickCount();
 #endif
 
-		int ready = poll(m_PollFds.GetList(), m_PollFds.GetLength(), interval.tv_sec * 1000);
+		DispatchSocketEvents(Timeout);
 
 #if defined(_WIN32) && defined(_DEBUG)
 		TickCount += GetTickCount() - TimeDiff;
 #endif
 
-		time(&g_CurrentTime);
+		CDnsQuery::ProcessTimeouts();
+		CDnsQuery::UnregisterSockets(DnsCookie);
+
+#if defined(_WIN32) && defined(_DEBUG)
+		DWORD Ticks = GetTickCount() - TickCount;
+
+		if (Ticks > 50) {
+			printf("Spent %d msec in the main loop.\n", Ticks);
+		}
+#endif
+	}
+
+#ifdef HAVE_LIBSSL
+	SSL_CTX_free(m_SSLContext);
+	SSL_CTX_free(m_SSLClientContext);
+#endif
+}
 
-		if (ready > 0) {
-			for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
-				pollfd *PollFd = SocketCursor->PollFd;
-				CSocketEvents *Events = SocketCursor->Events;
+/**
+ * DestroyPendingConnections
+ *
+ * Destroys connections which have been scheduled for destruction and
+ * whose ShouldDestroy() function agrees. Connections which aren't ready
+ * yet (e.g. because their timeout hasn't expired) remain in the list.
+ */
+void CCore::DestroyPendingConnections(void) {
+	for (CListCursor<CConnection *> ConnectionCursor(&m_PendingDestroy); ConnectionCursor.IsValid(); ConnectionCursor.Proceed()) {
+		if ((*ConnectionCursor)->ShouldDestroy()) {
+			(*ConnectionCursor)->Destroy();
+		}
+	}
+}
 
-				if (PollFd->fd != INVALID_SOCKET) {
-					if (PollFd->revents & (POLLERR|POLLHUP|POLLNVAL)) {
-						int ErrorCode;
-						socklen_t ErrorCodeLength = sizeof(ErrorCode);
+/**
+ * DispatchSocketEvents
+ *
+ * Waits for socket events and passes them on to the sockets' event
+ * interfaces.
+ *
+ * @param Timeout the timeout in milliseconds
+ */
+void CCore::DispatchSocketEvents(int Timeout) {
+	int ready = m_EventBackend->Wait(Timeout);
 
-						ErrorCode = 0;
+	time(&g_CurrentTime);
+	g_MonotonicTime = GetMonotonicTime();
 
-						if (getsockopt(PollFd->fd, SOL_SOCKET, SO_ERROR, (char *)&ErrorCode, &ErrorCodeLength) != -1) {
-							if (ErrorCode != 0) {
-								Events->Error(ErrorCode);
-							}
-						}
+	if (ready > 0) {
+		for (int i = 0; i < ready; i++) {
+			socket_t *Socket = m_EventBackend->GetReadySocket(i);
+			pollfd *PollFd = Socket->PollFd;
+			CSocketEvents *Events = Socket->Events;
+			short REvents = PollFd->revents;
 
-						if (ErrorCode == 0) {
-							Events->Error(-1);
-						}
+			PollFd->revents = 0;
 
-						Events->Destroy();
+			// the socket might have been unregistered by another socket's handler,
+			// the slot is cleared (or re-used with revents = 0) in that case
+			if (PollFd->fd == INVALID_SOCKET || REvents == 0) {
+				continue;
+			}
 
-						continue;
-					}
+			if (REvents & (POLLERR|POLLHUP|POLLNVAL)) {
+				int ErrorCode;
+				socklen_t ErrorCodeLength = sizeof(ErrorCode);
 
-					if (PollFd->revents & (POLLIN|POLLPRI)) {
-						int Code;
-						if ((Code = Events->Read()) != 0) {
-							Events->Error(Code);
-							Events->Destroy();
+				ErrorCode = 0;
 
-							continue;
-						}
+				if (getsockopt(PollFd->fd, SOL_SOCKET, SO_ERROR, (char *)&ErrorCode, &ErrorCodeLength) != -1) {
+					if (ErrorCode != 0) {
+						Events->Error(ErrorCode);
 					}
+				}
 
-					if (PollFd->revents & POLLOUT) {
-						Events->Write();
-					}
+				if (ErrorCode == 0) {
+					Events->Error(-1);
 				}
-			}
-		} else if (ready == -1) {
-#ifndef _WIN32
-			if (errno != EBADF && errno != 0) {
-#else
-			if (errno != WSAENOTSOCK) {
-#endif
+
+				Events->Destroy();
+
 				continue;
 			}
 
-			m_OtherSockets.Lock();
+			if (REvents & (POLLIN|POLLPRI)) {
+				int Code;
+				if ((Code = Events->Read()) != 0) {
+					Events->Error(Code);
+					Events->Destroy();
 
-			for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
-				if (SocketCursor->PollFd->fd == INVALID_SOCKET) {
 					continue;
 				}
+			}
 
-				pollfd pfd;
-				pfd.fd = SocketCursor->PollFd->fd;
-				pfd.events = POLLIN | POLLOUT | POLLERR;
-
-				int code = poll(&pfd, 1, 0);
+			if (REvents & POLLOUT) {
+				Events->Write();
+			}
 
-				if (code == -1) {
-					SocketCursor->Events->Error(-1);
-					SocketCursor->Events->Destroy();
-				}
+			// reading and writing can change the socket's state (e.g. for
+			// SSL connections) without any change to its send queue
+			if (PollFd->fd != INVALID_SOCKET && Socket->Events == Events) {
+				m_Sockets->MarkDirty(Socket);
 			}
 		}
+	} else if (ready == -1) {
+#ifndef _WIN32
+		if (errno != EBADF && errno != 0) {
+#else
+		if (errno != WSAENOTSOCK) {
+#endif
+			return;
+		}
 
-		CDnsQuery::ProcessTimeouts();
-		CDnsQuery::UnregisterSockets(DnsCookie);
+		for (int i = 0; i < m_Sockets->GetSlotCount(); i++) {
+			socket_t *Socket = m_Sockets->GetSlot(i);
 
-#if defined(_WIN32) && defined(_DEBUG)
-		DWORD Ticks = GetTickCount() - TickCount;
+			if (Socket->PollFd->fd == INVALID_SOCKET) {
+				continue;
+			}
 
-		if (Ticks > 50) {
-			printf("Spent %d msec in the main loop.\n", Ticks);
+			pollfd pfd;
+			pfd.fd = Socket->PollFd->fd;
+			pfd.events = POLLIN | POLLOUT | POLLERR;
+
+			int code = poll(&pfd, 1, 0);
+
+			if (code == -1) {
+				Socket->Events->Error(-1);
+				Socket->Events->Destroy();
+			}
 		}
-#endif
 	}
-
-#ifdef HAVE_LIBSSL
-	SSL_CTX_free(m_SSLContext);
-	SSL_CTX_free(m_SSLClientContext);
-#endif
 }
 
 /**
@@ -792,73 +897,98 @@ void CCore::UpdateModuleConfig(void) {
  * @param EventInterface the event interface for the socket
  */
 void CCore::RegisterSocket(SOCKET Socket, CSocketEvents *EventInterface) {
-	socket_s SocketStruct;
-	pollfd *PollFd = NULL;
-	pollfd NewPollFd;
-	bool NewStruct = true;
-	int i;
+	socket_t *SocketEntry;
 
 	UnregisterSocket(Socket);
 
-	for (i = 0; i < m_PollFds.GetLength(); i++) {
-		if (m_PollFds.Get(i).fd == INVALID_SOCKET) {
-			PollFd = m_PollFds.GetAddressOf(i);
-			NewStruct = false;
+	/* TODO: can we safely recover from this situation? return value maybe? */
+	SocketEntry = m_Sockets->Add(Socket, EventInterface);
 
-			break;
-		}
+	if (SocketEntry == NULL) {
+		Log("RegisterSocket() failed.");
+
+		Fatal();
 	}
 
-	if (NewStruct) {
-		PollFd = &NewPollFd;
+	m_EventBackend->AddSocket(SocketEntry);
+}
+
+/**
+ * UnregisterSocket
+ *
+ * Unregisters a socket and the associated event interface.
+ *
+ * @param Socket the socket
+ */
+void CCore::UnregisterSocket(SOCKET Socket) {
+	socket_t *SocketEntry;
+
+	if (m_Sockets == NULL || (SocketEntry = m_Sockets->GetByFd(Socket)) == NULL) {
+		return;
 	}
 
-	PollFd->fd = Socket;
-	PollFd->events = 0;
-	PollFd->revents = 0;
+	if (m_EventBackend != NULL) {
+		m_EventBackend->RemoveSocket(SocketEntry);
+	}
 
-	if (NewStruct) {
-		if (!m_PollFds.Insert(*PollFd)) {
-			Log("RegisterSocket() failed.");
+	m_Sockets->Remove(SocketEntry);
+}
 
-			Fatal();
-		}
+/**
+ * UpdateSocketEvents
+ *
+ * Notifies the main loop that the requested events for a socket might
+ * have changed, i.e. that the return value of the event interface's
+ * HasQueuedData() function might be different now.
+ *
+ * @param EventInterface the event interface
+ */
+void CCore::UpdateSocketEvents(CSocketEvents *EventInterface) {
+	socket_t *SocketEntry;
 
-		PollFd = m_PollFds.GetAddressOf(m_PollFds.GetLength() - 1);
+	if (m_Sockets == NULL || (SocketEntry = m_Sockets->GetByEvents(EventInterface)) == NULL) {
+		return;
 	}
 
-	// This relies on Preallocate() to be called for m_PollFds - otherwise
-	// the underlying address for PollFd might change when Insert() is called
-	// later on
-	SocketStruct.PollFd = PollFd;
-	SocketStruct.Events = EventInterface;
+	m_Sockets->MarkDirty(SocketEntry);
+}
 
-	/* TODO: can we safely recover from this situation? return value maybe? */
-	if (!m_OtherSockets.Insert(SocketStruct)) {
+/**
+ * ScheduleDestroy
+ *
+ * Adds a connection to the list of connections which are checked for
+ * ShouldDestroy() by the main loop.
+ *
+ * @param Connection the connection
+ */
+void CCore::ScheduleDestroy(CConnection *Connection) {
+	if (Connection->m_DestroyLink != NULL) {
+		return;
+	}
+
+	RESULT<link_t<CConnection *> *> Link = m_PendingDestroy.Insert(Connection);
+
+	if (IsError(Link)) {
 		Log("Insert() failed.");
 
 		Fatal();
 	}
+
+	Connection->m_DestroyLink = Link;
 }
 
 /**
- * UnregisterSocket
+ * CancelDestroy
  *
- * Unregisters a socket and the associated event interface.
+ * Removes a connection from the list of connections which are checked
+ * for ShouldDestroy() by the main loop.
  *
- * @param Socket the socket
+ * @param Connection the connection
  */
-void CCore::UnregisterSocket(SOCKET Socket) {
-	for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
-		if (SocketCursor->PollFd->fd == Socket) {
-			SocketCursor->PollFd->fd = INVALID_SOCKET;
-			SocketCursor->PollFd->events = 0;
-
-			SocketCursor.Remove();
+void CCore::CancelDestroy(CConnection *Connection) {
+	m_PendingDestroy.Remove(Connection->m_DestroyLink);
 
-			return;
-		}
-	}
+	Connection->m_DestroyLink = NULL;
 }
 
 /**
@@ -869,9 +999,43 @@ void CCore::UnregisterSocket(SOCKET Socket) {
  * @param Port the port for the listener
  * @param BindIp bind address (or NULL)
  * @param Family socket family (AF_INET or AF_INET6)
+ * @param ReusePort whether to use SO_REUSEPORT
  */
-SOCKET CCore::CreateListener(unsigned int Port, const char *BindIp, int Family) const {
-	return ::CreateListener(Port, BindIp, Family);
+SOCKET CCore::CreateListener(unsigned int Port, const char *BindIp, int Family, bool ReusePort) const {
+	return ::CreateListener(Port, BindIp, Family, ReusePort);
+}
+
+/**
+ * GetListenerSockets
+ *
+ * Returns the number of sockets which should be opened for each client
+ * listener (see system.listenersockets).
+ */
+int CCore::GetListenerSockets(void) const {
+	const char *Sockets = m_Config->ReadString("system.listenersockets");
+	int Count;
+
+	if (Sockets == NULL) {
+		return 1;
+	}
+
+	if (strcasecmp(Sockets, "auto") == 0) {
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+		Count = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+		Count = 1;
+#endif
+	} else {
+		Count = atoi(Sockets);
+	}
+
+	if (Count < 1) {
+		Count = 1;
+	} else if (Count > LISTENER_MAXSOCKETS) {
+		Count = LISTENER_MAXSOCKETS;
+	}
+
+	return Count;
 }
 
 /**
@@ -1329,17 +1493,7 @@ const char *const *CCore::GetArgV(void) const {
  * @param Events the event interface
  */
 bool CCore::IsRegisteredSocket(CSocketEvents *Events) const {
-	link_t<socket_t> *Current = m_OtherSockets.GetHead();
-
-	while (Current != NULL) {
-		if (Current->Value.Events == Events) {
-			return true;
-		}
-
-		Current = Current->Next;
-	}
-
-	return false;
+	return (m_Sockets->GetByEvents(Events) != NULL);
 }
 
 /**
@@ -1364,23 +1518,7 @@ SOCKET CCore::SocketAndConnect(const char *Host, unsigned int Port, const char *
  * @param Index index
  */
 const socket_t *CCore::GetSocketByClass(const char *Class, int Index) const {
-	int a = 0;
-
-	for (CListCursor<socket_t> SocketCursor(&m_OtherSockets); SocketCursor.IsValid(); SocketCursor.Proceed()) {
-		if ((*SocketCursor).PollFd->fd == INVALID_SOCKET) {
-			continue;
-		}
-
-		if (strcmp((*SocketCursor).Events->GetClassName(), Class) == 0) {
-			a++;
-		}
-
-		if (a - 1 == Index) {
-			return &(*SocketCursor);
-		}
-	}
-
-	return NULL;
+	return m_Sockets->GetByClass(Class, Index);
 }
 
 /**
@@ -1392,9 +1530,10 @@ const socket_t *CCore::GetSocketByClass(const char *Class, int Index) const {
  * @param Repeat whether the timer should repeat itself periodically
  * @param Function the timer function
  * @param Cookie a timer-specific cookie
+ * @param Milliseconds whether the interval is specified in milliseconds
  */
-CTimer *CCore::CreateTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie) const {
-	return new CTimer(Interval, Repeat, Function, Cookie);
+CTimer *CCore::CreateTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie, bool Milliseconds) const {
+	return new CTimer(Interval, Repeat, Function, Cookie, Milliseconds);
 }
 
 /**
@@ -1497,6 +1636,92 @@ int CCore::GetSSLCustomIndex(void) const {
 #endif
 }
 
+/**
+ * GetThreadPool
+ *
+ * Returns the pool of worker threads (or NULL if worker threads
+ * are disabled).
+ */
+CThreadPool *CCore::GetThreadPool(void) const {
+	return m_ThreadPool;
+}
+
+/**
+ * KernelTLSChanged
+ *
+ * Updates the number of connections which use kernel TLS.
+ *
+ * @param Delta the number of connections which were added (or removed)
+ */
+void CCore::KernelTLSChanged(int Delta) {
+	m_KernelTLSConnections += Delta;
+}
+
+/**
+ * GetSSLTicketKeys
+ *
+ * Returns the keys for SSL session tickets (or NULL if session
+ * tickets are disabled).
+ */
+CSSLTicketKeys *CCore::GetSSLTicketKeys(void) const {
+	return m_SSLTicketKeys;
+}
+
+/**
+ * InitializeSSLSessions
+ *
+ * Sets up the session cache and session tickets for client listeners
+ * so that clients can resume previous SSL sessions.
+ */
+void CCore::InitializeSSLSessions(void) {
+#ifdef HAVE_LIBSSL
+	int CacheSize = m_Config->ReadInteger("system.sslsessioncache");
+	int Timeout = m_Config->ReadInteger("system.sslsessiontimeout");
+
+	if (m_Config->ReadString("system.sslsessioncache") == NULL) {
+		CacheSize = 20480;
+	}
+
+	if (Timeout <= 0) {
+		Timeout = 86400;
+	}
+
+	if (CacheSize <= 0) {
+		SSL_CTX_set_session_cache_mode(m_SSLContext, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(m_SSLContext, SSL_OP_NO_TICKET);
+
+		return;
+	}
+
+	// sessions can't be resumed without a session id context when
+	// client certificates are requested
+	SSL_CTX_set_session_id_context(m_SSLContext, (const unsigned char *)"sbnc", 4);
+	SSL_CTX_set_session_cache_mode(m_SSLContext, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(m_SSLContext, CacheSize);
+	SSL_CTX_set_timeout(m_SSLContext, Timeout);
+
+	if (m_SSLTicketKeys == NULL) {
+		m_SSLTicketKeys = new CSSLTicketKeys(BuildPathConfig("sbnc.tickets"), Timeout);
+
+		if (AllocFailed(m_SSLTicketKeys)) {
+			Fatal();
+		}
+	}
+
+	m_SSLTicketKeys->Install(m_SSLContext);
+#endif /* HAVE_LIBSSL */
+}
+
+/**
+ * GetKernelTLSConnections
+ *
+ * Returns the number of connections for which the kernel performs the
+ * TLS encryption.
+ */
+unsigned int CCore::GetKernelTLSConnections(void) const {
+	return m_KernelTLSConnections;
+}
+
 #ifdef HAVE_LIBSSL
 /**
  * SSLVerifyCertificate
@@ -1583,6 +1808,191 @@ const char *CCore::DebugImpulse(int impulse) {
 		}
 	}
 
+	if (impulse == 13) {
+		CHashtable<int, false> *Table = new CHashtable<int, false>();
+		static char *Out = NULL;
+		char Key[32];
+		mtime_t Start, Inserted, Looked, Removed;
+		int Found = 0;
+
+#define BENCHMARK_KEYS 100000
+#define BENCHMARK_LOOKUPS 10
+
+		Start = GetMonotonicTime();
+
+		for (int a = 0; a < BENCHMARK_KEYS; a++) {
+			snprintf(Key, sizeof(Key), "Nick%d|away", a);
+			Table->Add(Key, a);
+		}
+
+		Inserted = GetMonotonicTime();
+
+		for (int l = 0; l < BENCHMARK_LOOKUPS; l++) {
+			for (int a = 0; a < BENCHMARK_KEYS; a++) {
+				snprintf(Key, sizeof(Key), "NICK%d|AWAY", a);
+
+				if (Table->Get(Key) == a) {
+					Found++;
+				}
+			}
+		}
+
+		Looked = GetMonotonicTime();
+
+		for (int a = 0; a < BENCHMARK_KEYS; a++) {
+			snprintf(Key, sizeof(Key), "nick%d|away", a);
+			Table->Remove(Key);
+		}
+
+		Removed = GetMonotonicTime();
+
+		delete Table;
+
+		free(Out);
+
+		int rc = asprintf(&Out, "%d keys: insert %d msecs, %d lookups (%d hits) %d msecs, remove %d msecs",
+			BENCHMARK_KEYS, (int)(Inserted - Start), BENCHMARK_KEYS * BENCHMARK_LOOKUPS, Found,
+			(int)(Looked - Inserted), (int)(Removed - Looked));
+
+		if (RcFailed(rc)) {}
+
+		return Out;
+	}
+
+	if (impulse == 14) {
+		static const char *DefaultCorpus[] = {
+			":irc.example.net 001 shroudbnc :Welcome to the Internet Relay Network shroudbnc!sbnc@localhost",
+			":irc.example.net 353 shroudbnc = #shroudbnc :@Gunnar +Alice Bob Carol Dave Eve Mallory Trent",
+			":Alice!alice@host.example.org PRIVMSG #shroudbnc :has anyone tried the new release yet?",
+			":Bob!~bob@192.0.2.17 NOTICE shroudbnc :\001VERSION mIRC v7.66\001",
+			"@time=2014-01-01T12:00:00.000Z;account=carol :Carol!carol@gateway/web/x JOIN #shroudbnc",
+			":Dave!dave@198.51.100.4 MODE #shroudbnc +ov Alice Bob",
+			":Eve!eve@203.0.113.9 QUIT :Ping timeout: 240 seconds",
+			"PING :irc.example.net",
+			":irc.example.net 005 shroudbnc CHANTYPES=# EXCEPTS INVEX CHANMODES=eIbq,k,flj,CFLMPQScgimnprstz"
+				" CHANLIMIT=#:120 PREFIX=(ov)@+ MAXLIST=bqeI:100 MODES=4 NETWORK=example KNOCK"
+				" STATUSMSG=@+ CALLERID=g :are supported by this server",
+			":Mallory!m@evil.example.com PART #shroudbnc :Leaving",
+			":Trent!t@trusted.example.com TOPIC #shroudbnc :shroudBNC support | be patient",
+			":Alice!alice@host.example.org PRIVMSG Bob :see you tomorrow"
+		};
+		static char *Out = NULL;
+		CVector<char *> Corpus;
+		char Line[IRCMESSAGE_MAXLENGTH];
+		mtime_t Start, Legacy, New;
+		unsigned int Count, Tokens = 0;
+
+		// lines which were captured from real IRC traffic can be put into
+		// parser.corpus (one line per message)
+		FILE *CorpusFile = fopen(BuildPathConfig("parser.corpus"), "r");
+
+		if (CorpusFile != NULL) {
+			while (fgets(Line, sizeof(Line), CorpusFile) != NULL) {
+				Line[strcspn(Line, "\r\n")] = '\0';
+
+				char *Dup = strdup(Line);
+
+				if (Line[0] != '\0' && !AllocFailed(Dup)) {
+					Corpus.Insert(Dup);
+				}
+			}
+
+			fclose(CorpusFile);
+		}
+
+		if (Corpus.GetLength() == 0) {
+			for (unsigned int i = 0; i < sizeof(DefaultCorpus) / sizeof(DefaultCorpus[0]); i++) {
+				char *Dup = strdup(DefaultCorpus[i]);
+
+				if (!AllocFailed(Dup)) {
+					Corpus.Insert(Dup);
+				}
+			}
+		}
+
+		if (Corpus.GetLength() == 0) {
+			return NULL;
+		}
+
+#define BENCHMARK_PARSES 1000000
+
+		Count = BENCHMARK_PARSES / Corpus.GetLength() * Corpus.GetLength();
+
+		Start = GetMonotonicTime();
+
+		for (unsigned int a = 0; a < Count; a++) {
+			const char *Raw = Corpus[a % Corpus.GetLength()];
+			tokendata_t Args = ArgTokenize2(Raw[0] == ':' ? Raw + 1 : Raw);
+			const char **argv = ArgToArray2(Args);
+
+			Tokens += ArgCount2(Args);
+
+			ArgFreeArray(argv);
+		}
+
+		Legacy = GetMonotonicTime();
+
+		for (unsigned int a = 0; a < Count; a++) {
+			ircmessage_t Message;
+
+			ArgTokenizeMessage(Corpus[a % Corpus.GetLength()], &Message);
+
+			Tokens += Message.ArgC;
+		}
+
+		New = GetMonotonicTime();
+
+		for (int i = 0; i < Corpus.GetLength(); i++) {
+			free(Corpus[i]);
+		}
+
+		free(Out);
+
+		int rc = asprintf(&Out, "%u lines (%u tokens): ArgTokenize2/ArgToArray2 %d msecs (%d lines/msec),"
+			" ArgTokenizeMessage %d msecs (%d lines/msec)", Count, Tokens, (int)(Legacy - Start),
+			(int)(Count / max(Legacy - Start, (mtime_t)1)), (int)(New - Legacy),
+			(int)(Count / max(New - Legacy, (mtime_t)1)));
+
+		if (RcFailed(rc)) {}
+
+		return Out;
+	}
+
+	if (impulse == 15) {
+		CFIFOBuffer *Buffer = new CFIFOBuffer();
+		CSharedLine *Line;
+		const char *Result = "OK";
+		char *Segment;
+		size_t Size;
+
+		// drain the buffer so that its (now empty) chunk is kept around
+		Buffer->WriteUnformattedLine(":fakeserver.fifo-test NOTICE * :drained");
+		Buffer->Read(Buffer->GetSize());
+
+		Line = CSharedLine::Create(":fakeserver.fifo-test PRIVMSG #random-channel :shared");
+
+		if (Line == NULL) {
+			delete Buffer;
+
+			return "Could not create shared line.";
+		}
+
+		Buffer->WriteSharedLine(Line);
+
+		Segment = Buffer->PeekSegment(&Size);
+
+		if (Segment == NULL || Size != Line->GetSize() || Size != Buffer->GetSize()) {
+			Result = "PeekSegment() did not return the shared line.";
+		} else if (memcmp(Segment, Line->GetData(), Size) != 0) {
+			Result = "PeekSegment() returned the wrong data.";
+		}
+
+		Line->Release();
+		delete Buffer;
+
+		return Result;
+	}
+
 	return NULL;
 }
 
@@ -1992,7 +2402,7 @@ RESULT<bool> CCore::AddAdditionalListener(unsigned int Port, const char *BindAdd
 		THROW(bool, Generic_Unknown, "Failed to create an SSL listener because there is no SSL server certificate.");
 	}
 
-	Listener = new CClientListener(Port, BindAddress, AF_INET, SSL);
+	Listener = new CClientListener(Port, BindAddress, AF_INET, SSL, GetListenerSockets());
 
 	if (Listener == NULL || !Listener->IsValid()) {
 		delete Listener;
@@ -2006,7 +2416,7 @@ RESULT<bool> CCore::AddAdditionalListener(unsigned int Port, const char *BindAdd
 		}
 	}
 
-	ListenerV6 = new CClientListener(Port, BindAddress, AF_INET6, SSL);
+	ListenerV6 = new CClientListener(Port, BindAddress, AF_INET6, SSL, GetListenerSockets());
 
 	if (ListenerV6 == NULL || !ListenerV6->IsValid()) {
 		delete ListenerV6;
@@ -21,6 +21,7 @@
 #define CORE_H
 
 #define DEFAULT_SENDQ (10 * 1024)
+#define MAINLOOP_BUSY_TIMEOUT 100 /**< poll timeout (in msecs) while modules are busy */
 
 class CConfig;
 class CUser;
@@ -33,6 +34,10 @@ class CModule;
 class CConnection;
 class CTimer;
 class CFakeClient;
+class CEventBackend;
+class CThreadPool;
+class CSSLTicketKeys;
+class CSocketTable;
 struct CSocketEvents;
 struct sockaddr_in;
 
@@ -108,8 +113,9 @@ class SBNCAPI CCore {
 
 	CHashtable<CUser *, false> m_Users; /**< the bouncer users */
 	CVector<CModule *> m_Modules; /**< currently loaded modules */
-	mutable CList<socket_t> m_OtherSockets; /**< a list of active sockets */
+	CSocketTable *m_Sockets; /**< the registered sockets */
 	CList<CTimer *> m_Timers; /**< a list of active timers */
+	CList<CConnection *> m_PendingDestroy; /**< connections which might have to be destroyed */
 
 	time_t m_Startup; /**< TS when the bouncer was started */
 
@@ -131,7 +137,12 @@ class SBNCAPI CCore {
 
 	CVector<CUser *> m_AdminUsers; /**< cached list of admin users */
 
-	CVector<pollfd> m_PollFds; /**< pollfd structures */
+	CEventBackend *m_EventBackend; /**< the backend for socket events */
+	CThreadPool *m_ThreadPool; /**< worker threads (or NULL if system.threads is 0) */
+	unsigned int m_KernelTLSConnections; /**< number of connections which use kernel TLS */
+	CSSLTicketKeys *m_SSLTicketKeys; /**< keys for SSL session tickets (or NULL) */
+
+	void InitializeSSLSessions(void);
 
 	sbnc_status_t m_Status; /**< shroudBNC's current status */
 
@@ -146,6 +157,9 @@ class SBNCAPI CCore {
 	void InitializeSocket(void);
 	void UninitializeSocket(void);
 
+	void DispatchSocketEvents(int Timeout);
+	void DestroyPendingConnections(void);
+
 	void InitializeAdditionalListeners(void);
 	void UninitializeAdditionalListeners(void);
 	void UpdateAdditionalListeners(void);
@@ -176,8 +190,13 @@ public:
 
 	void RegisterSocket(SOCKET Socket, CSocketEvents *EventInterface);
 	void UnregisterSocket(SOCKET Socket);
+	void UpdateSocketEvents(CSocketEvents *EventInterface);
+
+	void ScheduleDestroy(CConnection *Connection);
+	void CancelDestroy(CConnection *Connection);
 
-	SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET) const;
+	SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET, bool ReusePort = false) const;
+	int GetListenerSockets(void) const;
 
 	void Log(const char *Format, ...);
 	void LogUser(CUser *User, const char *Format, ...);
@@ -201,7 +220,7 @@ public:
 
 	const socket_t *GetSocketByClass(const char *Class, int Index) const;
 
-	CTimer *CreateTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie) const;
+	CTimer *CreateTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie, bool Milliseconds = false) const;
 
 	bool Match(const char *Pattern, const char *String) const;
 
@@ -219,6 +238,13 @@ public:
 	SSL_CTX *GetSSLClientContext(void);
 	int GetSSLCustomIndex(void) const;
 
+	CThreadPool *GetThreadPool(void) const;
+
+	void KernelTLSChanged(int Delta);
+	unsigned int GetKernelTLSConnections(void) const;
+
+	CSSLTicketKeys *GetSSLTicketKeys(void) const;
+
 	const char *DebugImpulse(int impulse);
 
 	const char *GetTagString(const char *Tag) const;
@@ -276,6 +302,7 @@ public:
 #ifndef SWIG
 extern CCore *g_Bouncer; /**< the main bouncer object */
 extern time_t g_CurrentTime; /**< the current time (updated in main loop) */
+extern mtime_t g_MonotonicTime; /**< the current monotonic time in milliseconds (updated in main loop) */
 #endif /* SWIG */
 
 #endif /* CORE_H */
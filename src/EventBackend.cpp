@@ -0,0 +1,345 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/**
+ * Create
+ *
+ * Creates an event backend. If the requested backend is not available
+ * the poll() backend is used instead.
+ *
+ * @param Name the name of the backend (or NULL for the default backend)
+ * @param Sockets the registered sockets
+ */
+CEventBackend *CEventBackend::Create(const char *Name, CSocketTable *Sockets) {
+#ifdef HAVE_SYS_EPOLL_H
+	if (Name == NULL || strcasecmp(Name, "epoll") == 0) {
+		CEpollEventBackend *Epoll = new CEpollEventBackend(Sockets);
+
+		if (Epoll->IsValid()) {
+			return Epoll;
+		}
+
+		delete Epoll;
+	}
+#endif /* HAVE_SYS_EPOLL_H */
+
+	return new CPollEventBackend(Sockets, SFD_SETSIZE);
+}
+
+/**
+ * CPollEventBackend
+ *
+ * Constructs a new poll() backend.
+ *
+ * @param Sockets the registered sockets
+ * @param SlotCount the maximum number of sockets
+ */
+CPollEventBackend::CPollEventBackend(CSocketTable *Sockets, int SlotCount) {
+	m_Sockets = Sockets;
+	m_Ready = (socket_t **)malloc(SlotCount * sizeof(socket_t *));
+
+	if (AllocFailed(m_Ready)) {
+		g_Bouncer->Fatal();
+	}
+}
+
+/**
+ * ~CPollEventBackend
+ *
+ * Destructs a poll() backend.
+ */
+CPollEventBackend::~CPollEventBackend(void) {
+	free(m_Ready);
+}
+
+/**
+ * GetName
+ *
+ * Returns the name of the backend.
+ */
+const char *CPollEventBackend::GetName(void) const {
+	return "poll";
+}
+
+/**
+ * AddSocket
+ *
+ * Nothing to do here, the socket table assigns a pollfd slot.
+ *
+ * @param Socket the socket
+ */
+bool CPollEventBackend::AddSocket(socket_t *Socket) {
+	return true;
+}
+
+/**
+ * RemoveSocket
+ *
+ * Nothing to do here, the socket table releases the pollfd slot.
+ *
+ * @param Socket the socket
+ */
+void CPollEventBackend::RemoveSocket(socket_t *Socket) {
+}
+
+/**
+ * UpdateSocket
+ *
+ * Nothing to do here, poll() reads the events from the pollfd structures.
+ *
+ * @param Socket the socket
+ */
+void CPollEventBackend::UpdateSocket(socket_t *Socket) {
+}
+
+/**
+ * Wait
+ *
+ * Calls poll() for all pollfd structures.
+ *
+ * @param Timeout the timeout in milliseconds
+ */
+int CPollEventBackend::Wait(int Timeout) {
+	pollfd *PollFds = m_Sockets->GetPollFds()->GetList();
+	int Count = m_Sockets->GetSlotCount();
+	int Ready, i, a = 0;
+
+	Ready = poll(PollFds, Count, Timeout);
+
+	if (Ready <= 0) {
+		return Ready;
+	}
+
+	for (i = 0; i < Count && a < Ready; i++) {
+		if (PollFds[i].revents != 0 && PollFds[i].fd != INVALID_SOCKET) {
+			m_Ready[a++] = m_Sockets->GetSlot(i);
+		}
+	}
+
+	return a;
+}
+
+/**
+ * GetReadySocket
+ *
+ * Returns a socket which was reported by the last call to Wait().
+ *
+ * @param Index the index
+ */
+socket_t *CPollEventBackend::GetReadySocket(int Index) const {
+	return m_Ready[Index];
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * CEpollEventBackend
+ *
+ * Constructs a new epoll backend.
+ *
+ * @param Sockets the registered sockets
+ */
+CEpollEventBackend::CEpollEventBackend(CSocketTable *Sockets) {
+#ifdef HAVE_EPOLL_CREATE1
+	m_EpollFd = epoll_create1(EPOLL_CLOEXEC);
+#else /* HAVE_EPOLL_CREATE1 */
+	m_EpollFd = epoll_create(SFD_SETSIZE);
+#endif /* HAVE_EPOLL_CREATE1 */
+
+	m_Sockets = Sockets;
+}
+
+/**
+ * ~CEpollEventBackend
+ *
+ * Destructs an epoll backend.
+ */
+CEpollEventBackend::~CEpollEventBackend(void) {
+	if (m_EpollFd != -1) {
+		close(m_EpollFd);
+	}
+}
+
+/**
+ * IsValid
+ *
+ * Checks whether the epoll descriptor could be created.
+ */
+bool CEpollEventBackend::IsValid(void) const {
+	return (m_EpollFd != -1);
+}
+
+/**
+ * GetName
+ *
+ * Returns the name of the backend.
+ */
+const char *CEpollEventBackend::GetName(void) const {
+	return "epoll";
+}
+
+/**
+ * Control
+ *
+ * Adds, modifies or removes a socket's epoll registration.
+ *
+ * @param Operation EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+ * @param Socket the socket
+ */
+bool CEpollEventBackend::Control(int Operation, socket_t *Socket) {
+	epoll_event Event;
+	short Events = Socket->PollFd->events;
+
+	memset(&Event, 0, sizeof(Event));
+
+	if (Events & POLLIN) {
+		Event.events |= EPOLLIN;
+	}
+
+	if (Events & POLLPRI) {
+		Event.events |= EPOLLPRI;
+	}
+
+	if (Events & POLLOUT) {
+		Event.events |= EPOLLOUT;
+	}
+
+	Event.data.fd = Socket->PollFd->fd;
+
+	if (epoll_ctl(m_EpollFd, Operation, Socket->PollFd->fd, &Event) == 0) {
+		return true;
+	}
+
+	/* the descriptor might still be in the epoll set if it was closed
+	 * while another descriptor for the same socket was open */
+	if (Operation == EPOLL_CTL_ADD && errno == EEXIST) {
+		return (epoll_ctl(m_EpollFd, EPOLL_CTL_MOD, Socket->PollFd->fd, &Event) == 0);
+	}
+
+	return false;
+}
+
+/**
+ * AddSocket
+ *
+ * Adds a socket to the epoll set.
+ *
+ * @param Socket the socket
+ */
+bool CEpollEventBackend::AddSocket(socket_t *Socket) {
+	if (!Control(EPOLL_CTL_ADD, Socket)) {
+		g_Bouncer->Log("epoll_ctl() failed for socket %d: %s",
+			Socket->PollFd->fd, strerror(errno));
+
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * RemoveSocket
+ *
+ * Removes a socket from the epoll set.
+ *
+ * @param Socket the socket
+ */
+void CEpollEventBackend::RemoveSocket(socket_t *Socket) {
+	/* this fails if the socket has already been closed, in which case
+	 * the kernel has already removed it from the epoll set */
+	Control(EPOLL_CTL_DEL, Socket);
+}
+
+/**
+ * UpdateSocket
+ *
+ * Updates the events for a socket.
+ *
+ * @param Socket the socket
+ */
+void CEpollEventBackend::UpdateSocket(socket_t *Socket) {
+	Control(EPOLL_CTL_MOD, Socket);
+}
+
+/**
+ * Wait
+ *
+ * Calls epoll_wait() and stores the reported events in the sockets'
+ * pollfd structures.
+ *
+ * @param Timeout the timeout in milliseconds
+ */
+int CEpollEventBackend::Wait(int Timeout) {
+	int Ready, i, a = 0;
+
+	Ready = epoll_wait(m_EpollFd, m_Events, EPOLL_MAXEVENTS, Timeout);
+
+	for (i = 0; i < Ready; i++) {
+		int Fd = m_Events[i].data.fd;
+		unsigned int Events = m_Events[i].events;
+		socket_t *Socket;
+		short REvents = 0;
+
+		if ((Socket = m_Sockets->GetByFd(Fd)) == NULL) {
+			continue;
+		}
+
+		if (Events & EPOLLIN) {
+			REvents |= POLLIN;
+		}
+
+		if (Events & EPOLLPRI) {
+			REvents |= POLLPRI;
+		}
+
+		if (Events & EPOLLOUT) {
+			REvents |= POLLOUT;
+		}
+
+		if (Events & EPOLLERR) {
+			REvents |= POLLERR;
+		}
+
+		if (Events & EPOLLHUP) {
+			REvents |= POLLHUP;
+		}
+
+		Socket->PollFd->revents = REvents;
+		m_Ready[a++] = Socket;
+	}
+
+	if (Ready < 0) {
+		return Ready;
+	}
+
+	return a;
+}
+
+/**
+ * GetReadySocket
+ *
+ * Returns a socket which was reported by the last call to Wait().
+ *
+ * @param Index the index
+ */
+socket_t *CEpollEventBackend::GetReadySocket(int Index) const {
+	return m_Ready[Index];
+}
+#endif /* HAVE_SYS_EPOLL_H */
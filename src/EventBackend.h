@@ -0,0 +1,154 @@
+/*******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef EVENTBACKEND_H
+#define EVENTBACKEND_H
+
+class CSocketTable;
+
+/**
+ * CEventBackend
+ *
+ * An interface for the socket notification mechanism which is used by
+ * the main loop. The backend reports which registered sockets are ready,
+ * the socket's pollfd structure holds the requested events (events) and
+ * the events which were reported by the last call to Wait() (revents).
+ */
+class SBNCAPI CEventBackend {
+public:
+	/**
+	 * ~CEventBackend
+	 *
+	 * Destructor.
+	 */
+	virtual ~CEventBackend(void) {}
+
+	/**
+	 * GetName
+	 *
+	 * Returns the name of the backend.
+	 */
+	virtual const char *GetName(void) const = 0;
+
+	/**
+	 * AddSocket
+	 *
+	 * Called when a socket has been registered.
+	 *
+	 * @param Socket the socket
+	 */
+	virtual bool AddSocket(socket_t *Socket) = 0;
+
+	/**
+	 * RemoveSocket
+	 *
+	 * Called when a socket is about to be unregistered.
+	 *
+	 * @param Socket the socket
+	 */
+	virtual void RemoveSocket(socket_t *Socket) = 0;
+
+	/**
+	 * UpdateSocket
+	 *
+	 * Called when the requested events for a socket have changed.
+	 *
+	 * @param Socket the socket
+	 */
+	virtual void UpdateSocket(socket_t *Socket) = 0;
+
+	/**
+	 * Wait
+	 *
+	 * Waits for socket events and returns the number of ready sockets
+	 * (or -1 if an error occured, errno is set accordingly).
+	 *
+	 * @param Timeout the timeout in milliseconds
+	 */
+	virtual int Wait(int Timeout) = 0;
+
+	/**
+	 * GetReadySocket
+	 *
+	 * Returns a socket which was reported by the last call to Wait().
+	 *
+	 * @param Index the index of the socket (0 <= Index < the return
+	 *				value of Wait())
+	 */
+	virtual socket_t *GetReadySocket(int Index) const = 0;
+
+	static CEventBackend *Create(const char *Name, CSocketTable *Sockets);
+};
+
+#ifndef SWIG
+/**
+ * CPollEventBackend
+ *
+ * An event backend which uses poll().
+ */
+class CPollEventBackend : public CEventBackend {
+	CSocketTable *m_Sockets; /**< the registered sockets */
+	socket_t **m_Ready; /**< sockets which were reported by the last Wait() */
+
+public:
+	CPollEventBackend(CSocketTable *Sockets, int SlotCount);
+	virtual ~CPollEventBackend(void);
+
+	virtual const char *GetName(void) const;
+	virtual bool AddSocket(socket_t *Socket);
+	virtual void RemoveSocket(socket_t *Socket);
+	virtual void UpdateSocket(socket_t *Socket);
+	virtual int Wait(int Timeout);
+	virtual socket_t *GetReadySocket(int Index) const;
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+/** Defines how many events are fetched by a single call to epoll_wait() */
+#define EPOLL_MAXEVENTS 256
+
+/**
+ * CEpollEventBackend
+ *
+ * An event backend which uses Linux' epoll interface. Only sockets which
+ * are actually ready are reported.
+ */
+class CEpollEventBackend : public CEventBackend {
+	int m_EpollFd; /**< the epoll descriptor */
+	CSocketTable *m_Sockets; /**< the registered sockets */
+	epoll_event m_Events[EPOLL_MAXEVENTS]; /**< events from the last Wait() */
+	socket_t *m_Ready[EPOLL_MAXEVENTS]; /**< sockets from the last Wait() */
+
+	bool Control(int Operation, socket_t *Socket);
+public:
+	CEpollEventBackend(CSocketTable *Sockets);
+	virtual ~CEpollEventBackend(void);
+
+	bool IsValid(void) const;
+
+	virtual const char *GetName(void) const;
+	virtual bool AddSocket(socket_t *Socket);
+	virtual void RemoveSocket(socket_t *Socket);
+	virtual void UpdateSocket(socket_t *Socket);
+	virtual int Wait(int Timeout);
+	virtual socket_t *GetReadySocket(int Index) const;
+};
+#endif /* HAVE_SYS_EPOLL_H */
+#endif /* SWIG */
+
+#endif /* EVENTBACKEND_H */
@@ -1,4 +1,4 @@
-/*******************************************************************************
+/******************************************************************************
  * shroudBNC - an object-oriented framework for IRC                            *
  * Copyright (C) 2005-2014 Gunnar Beutner                                      *
  *                                                                             *
@@ -19,15 +19,102 @@
 
 #include "StdAfx.h"
 
+static fifochunk_t *g_ChunkPool = NULL; /**< unused chunks */
+static int g_ChunkPoolCount = 0; /**< the number of unused chunks */
+static fifochunk_t *g_SharedChunkPool = NULL; /**< unused chunk headers for shared lines */
+static int g_SharedChunkPoolCount = 0; /**< the number of unused chunk headers */
+
+/**
+ * Create
+ *
+ * Creates a new shared line with a reference count of 1. The line is
+ * terminated with CRLF. NULL is returned if the line could not be allocated.
+ *
+ * @param Line the line
+ */
+CSharedLine *CSharedLine::Create(const char *Line) {
+	size_t Length = strlen(Line);
+	CSharedLine *SharedLine = (CSharedLine *)malloc(sizeof(CSharedLine) + Length + 2);
+
+	if (AllocFailed(SharedLine)) {
+		return NULL;
+	}
+
+	SharedLine->m_RefCount = 1;
+	SharedLine->m_Size = Length + 2;
+	SharedLine->m_TagsLength = ArgStripTags(Line) - Line;
+
+	char *Data = (char *)(SharedLine + 1);
+
+	memcpy(Data, Line, Length);
+	Data[Length] = '\r';
+	Data[Length + 1] = '\n';
+
+	return SharedLine;
+}
+
+/**
+ * Reference
+ *
+ * Increments the line's reference count.
+ */
+void CSharedLine::Reference(void) {
+	m_RefCount++;
+}
+
+/**
+ * Release
+ *
+ * Decrements the line's reference count and frees the line when there
+ * are no references left.
+ */
+void CSharedLine::Release(void) {
+	m_RefCount--;
+
+	if (m_RefCount == 0) {
+		free(this);
+	}
+}
+
+/**
+ * GetData
+ *
+ * Returns the line's data. The data is not NUL-terminated.
+ */
+const char *CSharedLine::GetData(void) const {
+	return (const char *)(this + 1);
+}
+
+/**
+ * GetSize
+ *
+ * Returns the size of the line's data (including the CRLF).
+ */
+size_t CSharedLine::GetSize(void) const {
+	return m_Size;
+}
+
+/**
+ * GetTagsLength
+ *
+ * Returns the number of bytes at the start of the line which are used by
+ * the line's tags, i.e. the offset of the line's prefix or command.
+ */
+size_t CSharedLine::GetTagsLength(void) const {
+	return m_TagsLength;
+}
+
 /**
  * CFIFOBuffer
  *
  * Constructs a new fifo buffer.
  */
 CFIFOBuffer::CFIFOBuffer() {
-	m_Buffer = NULL;
-	m_BufferSize = 0;
-	m_Offset = 0;
+	m_Head = NULL;
+	m_Tail = NULL;
+	m_Size = 0;
+	m_NotifyProc = NULL;
+	m_NotifyCookie = NULL;
 }
 
 /**
@@ -36,77 +123,154 @@ CFIFOBuffer::CFIFOBuffer() {
  * Destructs a fifo buffer.
  */
 CFIFOBuffer::~CFIFOBuffer() {
-	free(m_Buffer);
+	while (m_Head != NULL) {
+		fifochunk_t *Next = m_Head->Next;
+
+		FreeChunk(m_Head);
+
+		m_Head = Next;
+	}
 }
 
 /**
- * ResizeBuffer
+ * AllocChunk
  *
- * Resizes a buffer. The new size of the buffer will be a multiple
- * of BLOCKSIZE. NULL is returned if the buffer could not be successfully
- * resized.
+ * Allocates a chunk which can hold at least the specified number of bytes.
+ * Chunks of the default size are taken from the chunk pool if possible.
+ * NULL is returned if the chunk could not be allocated.
  *
- * @param Buffer the buffer which is to be resized
- * @param OldSize the old size of the buffer
- * @param NewSize the new size of the buffer
+ * @param Size the minimum size of the chunk
  */
-void *CFIFOBuffer::ResizeBuffer(void *Buffer, size_t OldSize, size_t NewSize) {
-	if (OldSize != 0) {
-		OldSize += BLOCKSIZE - (OldSize % BLOCKSIZE);
-	}
-
-	size_t CeilNewSize = NewSize + BLOCKSIZE - (NewSize % BLOCKSIZE);
+fifochunk_t *CFIFOBuffer::AllocChunk(size_t Size) {
+	fifochunk_t *Chunk;
 
-	size_t OldBlocks = OldSize / BLOCKSIZE;
-	size_t NewBlocks = CeilNewSize / BLOCKSIZE;
+	if (Size <= BLOCKSIZE && g_ChunkPool != NULL) {
+		Chunk = g_ChunkPool;
+		g_ChunkPool = Chunk->Next;
+		g_ChunkPoolCount--;
+	} else {
+		if (Size < BLOCKSIZE) {
+			Size = BLOCKSIZE;
+		}
 
-	if (NewBlocks != OldBlocks) {
-		if (NewSize == 0) {
-			free(Buffer);
+		Chunk = (fifochunk_t *)malloc(sizeof(fifochunk_t) + Size);
 
+		if (Chunk == NULL) {
 			return NULL;
-		} else {
-			return realloc(Buffer, NewBlocks * BLOCKSIZE);
 		}
-	} else {
-		return Buffer;
+
+		Chunk->Data = (char *)(Chunk + 1);
+		Chunk->Size = Size;
 	}
+
+	Chunk->Next = NULL;
+	Chunk->Shared = NULL;
+	Chunk->Start = 0;
+	Chunk->End = 0;
+
+	return Chunk;
 }
 
 /**
- * Optimize
+ * AllocSharedChunk
  *
- * Optimizes the memory usage of a buffer.
+ * Allocates a chunk which refers to a shared line and takes a new reference
+ * to the line. NULL is returned if the chunk could not be allocated.
+ *
+ * @param Line the shared line
+ * @param Offset the number of bytes at the start of the line which are skipped
  */
-void CFIFOBuffer::Optimize(void) {
-	char *NewBuffer;
+fifochunk_t *CFIFOBuffer::AllocSharedChunk(CSharedLine *Line, size_t Offset) {
+	fifochunk_t *Chunk;
+
+	if (g_SharedChunkPool != NULL) {
+		Chunk = g_SharedChunkPool;
+		g_SharedChunkPool = Chunk->Next;
+		g_SharedChunkPoolCount--;
+	} else {
+		Chunk = (fifochunk_t *)malloc(sizeof(fifochunk_t));
 
-	if (m_Offset == 0 || m_Offset < m_BufferSize / 5) {
-		return;
+		if (Chunk == NULL) {
+			return NULL;
+		}
 	}
 
-	if (m_BufferSize - m_Offset <= 0) {
-		free(m_Buffer);
+	Line->Reference();
 
-		m_Buffer = NULL;
-		m_BufferSize = 0;
-		m_Offset = 0;
+	Chunk->Next = NULL;
+	Chunk->Shared = Line;
+	Chunk->Data = (char *)Line->GetData() + Offset;
+	Chunk->Size = Line->GetSize() - Offset;
+	Chunk->Start = 0;
+	Chunk->End = Chunk->Size;
+
+	return Chunk;
+}
 
-		return;
+/**
+ * FreeChunk
+ *
+ * Returns a chunk to the chunk pool or frees it.
+ *
+ * @param Chunk the chunk
+ */
+void CFIFOBuffer::FreeChunk(fifochunk_t *Chunk) {
+	if (Chunk->Shared != NULL) {
+		Chunk->Shared->Release();
+
+		if (g_SharedChunkPoolCount < CHUNKPOOLSIZE) {
+			Chunk->Next = g_SharedChunkPool;
+			g_SharedChunkPool = Chunk;
+			g_SharedChunkPoolCount++;
+		} else {
+			free(Chunk);
+		}
+	} else if (Chunk->Size == BLOCKSIZE && g_ChunkPoolCount < CHUNKPOOLSIZE) {
+		Chunk->Next = g_ChunkPool;
+		g_ChunkPool = Chunk;
+		g_ChunkPoolCount++;
+	} else {
+		free(Chunk);
 	}
+}
 
-	NewBuffer = (char *)ResizeBuffer(NULL, 0, m_BufferSize - m_Offset);
+/**
+ * Append
+ *
+ * Appends data to the buffer without calling the notify function.
+ *
+ * @param Data a pointer to the data
+ * @param Size the number of bytes
+ */
+bool CFIFOBuffer::Append(const char *Data, size_t Size) {
+	while (Size > 0) {
+		if (m_Tail == NULL || m_Tail->Shared != NULL || m_Tail->End == m_Tail->Size) {
+			fifochunk_t *Chunk = AllocChunk(BLOCKSIZE);
+
+			if (AllocFailed(Chunk)) {
+				return false;
+			}
+
+			if (m_Tail != NULL) {
+				m_Tail->Next = Chunk;
+			} else {
+				m_Head = Chunk;
+			}
+
+			m_Tail = Chunk;
+		}
 
-	if (AllocFailed(NewBuffer)) {
-		return;
-	}
+		size_t Count = min(Size, m_Tail->Size - m_Tail->End);
 
-	memcpy(NewBuffer, m_Buffer + m_Offset, m_BufferSize - m_Offset);
+		memcpy(m_Tail->Data + m_Tail->End, Data, Count);
+		m_Tail->End += Count;
+		m_Size += Count;
 
-	free(m_Buffer);
-	m_Buffer = NewBuffer;
-	m_BufferSize -= m_Offset;
-	m_Offset = 0;
+		Data += Count;
+		Size -= Count;
+	}
+
+	return true;
 }
 
 /**
@@ -115,25 +279,168 @@ void CFIFOBuffer::Optimize(void) {
  * Returns the size of the buffer.
  */
 size_t CFIFOBuffer::GetSize(void) const {
-	return m_BufferSize - m_Offset;
+	return m_Size;
 }
 
 /**
  * Peek
  *
  * Returns a pointer to the buffer's data without advancing the read pointer (or
- * NULL if there is no data left in the buffer).
+ * NULL if there is no data left in the buffer). The buffer's data has to be
+ * moved into a single chunk for this, so PeekSegment() and GetSegments()
+ * should be used instead where possible.
+ */
+char *CFIFOBuffer::Peek(void) {
+	return Linearize(m_Size);
+}
+
+/**
+ * PeekSegment
+ *
+ * Returns a pointer to the first contiguous part of the buffer's data
+ * (or NULL if there is no data left in the buffer).
+ *
+ * @param Size returns the number of bytes in the segment
  */
-char *CFIFOBuffer::Peek(void) const {
-	if (GetSize() == 0) {
+char *CFIFOBuffer::PeekSegment(size_t *Size) const {
+	fifochunk_t *Chunk = m_Head;
+
+	if (m_Size == 0) {
+		*Size = 0;
+
 		return NULL;
-	} else {
-		return m_Buffer + m_Offset;
 	}
+
+	// empty chunks never hold up the data behind them
+	while (Chunk->End == Chunk->Start) {
+		Chunk = Chunk->Next;
+	}
+
+	*Size = Chunk->End - Chunk->Start;
+
+	return Chunk->Data + Chunk->Start;
+}
+
+/**
+ * GetSegments
+ *
+ * Returns the contiguous parts of the buffer's data (e.g. for use with
+ * writev()). Returns the number of segments.
+ *
+ * @param Segments an array which receives the segments
+ * @param Count the maximum number of segments
+ */
+int CFIFOBuffer::GetSegments(fifosegment_t *Segments, int Count) const {
+	int i = 0;
+
+	for (fifochunk_t *Chunk = m_Head; Chunk != NULL && i < Count; Chunk = Chunk->Next) {
+		if (Chunk->End == Chunk->Start) {
+			continue;
+		}
+
+		Segments[i].Data = Chunk->Data + Chunk->Start;
+		Segments[i].Size = Chunk->End - Chunk->Start;
+		i++;
+	}
+
+	return i;
+}
+
+/**
+ * Find
+ *
+ * Looks for the first occurrence of a character in the buffer.
+ *
+ * @param Character the character
+ * @param Offset returns the character's offset
+ */
+bool CFIFOBuffer::Find(char Character, size_t *Offset) const {
+	size_t Skipped = 0;
+
+	for (fifochunk_t *Chunk = m_Head; Chunk != NULL; Chunk = Chunk->Next) {
+		size_t Size = Chunk->End - Chunk->Start;
+		const char *Match = (const char *)memchr(Chunk->Data + Chunk->Start, Character, Size);
+
+		if (Match != NULL) {
+			*Offset = Skipped + (Match - (Chunk->Data + Chunk->Start));
+
+			return true;
+		}
+
+		Skipped += Size;
+	}
+
+	return false;
 }
 
 /**
- * Reads and returns the specified amount of bytes from the buffer.
+ * Linearize
+ *
+ * Makes sure that the first Bytes bytes of the buffer are stored
+ * contiguously and returns a pointer to them (or NULL if there is no
+ * data left in the buffer).
+ *
+ * @param Bytes the number of bytes
+ */
+char *CFIFOBuffer::Linearize(size_t Bytes) {
+	fifochunk_t *Chunk;
+
+	if (m_Size == 0) {
+		return NULL;
+	}
+
+	if (Bytes > m_Size) {
+		Bytes = m_Size;
+	}
+
+	while (m_Head->End == m_Head->Start) {
+		fifochunk_t *Next = m_Head->Next;
+
+		FreeChunk(m_Head);
+
+		m_Head = Next;
+	}
+
+	if (m_Head->End - m_Head->Start >= Bytes) {
+		return m_Head->Data + m_Head->Start;
+	}
+
+	Chunk = AllocChunk(Bytes);
+
+	if (AllocFailed(Chunk)) {
+		g_Bouncer->Fatal();
+	}
+
+	while (Chunk->End < Bytes) {
+		size_t Count = min(Bytes - Chunk->End, m_Head->End - m_Head->Start);
+
+		memcpy(Chunk->Data + Chunk->End, m_Head->Data + m_Head->Start, Count);
+		Chunk->End += Count;
+		m_Head->Start += Count;
+
+		if (m_Head->Start == m_Head->End) {
+			fifochunk_t *Next = m_Head->Next;
+
+			if (m_Head == m_Tail) {
+				m_Tail = Chunk;
+			}
+
+			FreeChunk(m_Head);
+
+			m_Head = Next;
+		}
+	}
+
+	Chunk->Next = m_Head;
+	m_Head = Chunk;
+
+	return m_Head->Data;
+}
+
+/**
+ * Reads the specified amount of bytes from the buffer. Returns a pointer
+ * to the data which was read; only the part which was returned by
+ * PeekSegment() is contiguous.
  *
  * @param Bytes the number of bytes which should be read from the buffer.
  *              If this value is greater than the size of the buffer,
@@ -141,15 +448,50 @@ char *CFIFOBuffer::Peek(void) const {
  */
 char *CFIFOBuffer::Read(size_t Bytes) {
 	char *ReturnValue;
+	size_t Contiguous;
+	bool WasEmpty = (m_Size == 0);
 
-	Optimize();
+	if (WasEmpty) {
+		return NULL;
+	}
 
-	ReturnValue = m_Buffer + m_Offset;
+	ReturnValue = PeekSegment(&Contiguous);
 
-	if (Bytes > GetSize()) {
-		m_Offset += GetSize();
-	} else {
-		m_Offset += Bytes;
+	if (Bytes > m_Size) {
+		Bytes = m_Size;
+	}
+
+	m_Size -= Bytes;
+
+	while (Bytes > 0) {
+		size_t Count = min(Bytes, m_Head->End - m_Head->Start);
+
+		m_Head->Start += Count;
+		Bytes -= Count;
+
+		if (m_Head->Start == m_Head->End) {
+			if (m_Head == m_Tail && m_Head->Shared == NULL) {
+				// the last chunk is kept and reused for new data
+				m_Head->Start = 0;
+				m_Head->End = 0;
+
+				break;
+			}
+
+			fifochunk_t *Next = m_Head->Next;
+
+			if (m_Head == m_Tail) {
+				m_Tail = NULL;
+			}
+
+			FreeChunk(m_Head);
+
+			m_Head = Next;
+		}
+	}
+
+	if (m_Size == 0 && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
 	}
 
 	return ReturnValue;
@@ -164,18 +506,38 @@ char *CFIFOBuffer::Read(size_t Bytes) {
  * @param Size the number of bytes which should be written
  */
 RESULT<bool> CFIFOBuffer::Write(const char *Data, size_t Size) {
-	char *tempBuffer;
+	bool WasEmpty = (m_Size == 0);
+
+	if (!Append(Data, Size)) {
+		THROW(bool, Generic_OutOfMemory, "AllocChunk() failed.");
+	}
+
+	if (WasEmpty && Size > 0 && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
+
+	RETURN(bool, true);
+}
 
-	tempBuffer = (char *)ResizeBuffer(m_Buffer, m_BufferSize,
-		m_BufferSize + Size);
+/**
+ * Write
+ *
+ * Appends a copy of another buffer's data.
+ *
+ * @param Buffer the buffer
+ */
+RESULT<bool> CFIFOBuffer::Write(const CFIFOBuffer *Buffer) {
+	bool WasEmpty = (m_Size == 0);
 
-	if (AllocFailed(tempBuffer)) {
-		THROW(bool, Generic_OutOfMemory, "ResizeBuffer() failed.");
+	for (fifochunk_t *Chunk = Buffer->m_Head; Chunk != NULL; Chunk = Chunk->Next) {
+		if (!Append(Chunk->Data + Chunk->Start, Chunk->End - Chunk->Start)) {
+			THROW(bool, Generic_OutOfMemory, "AllocChunk() failed.");
+		}
 	}
 
-	m_Buffer = tempBuffer;
-	memcpy(m_Buffer + m_BufferSize, Data, Size);
-	m_BufferSize += Size;
+	if (WasEmpty && m_Size > 0 && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
 
 	RETURN(bool, true);
 }
@@ -188,19 +550,119 @@ RESULT<bool> CFIFOBuffer::Write(const char *Data, size_t Size) {
  * @param Line the line
  */
 RESULT<bool> CFIFOBuffer::WriteUnformattedLine(const char *Line) {
-	size_t Length = strlen(Line);
+	bool WasEmpty = (m_Size == 0);
+
+	if (!Append(Line, strlen(Line)) || !Append("\r\n", 2)) {
+		THROW(bool, Generic_OutOfMemory, "AllocChunk() failed.");
+	}
+
+	if (WasEmpty && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
+
+	RETURN(bool, true);
+}
+
+/**
+ * Reserve
+ *
+ * Returns a pointer to the free space at the end of the buffer, so that
+ * data can be received directly into the buffer. A new chunk is allocated
+ * if there are less than MinSize bytes available in the last chunk. NULL
+ * is returned if the chunk could not be allocated. Commit() must be called
+ * once the data has been written.
+ *
+ * @param MinSize the minimum number of bytes
+ * @param Size returns the number of bytes which are available
+ */
+char *CFIFOBuffer::Reserve(size_t MinSize, size_t *Size) {
+	if (m_Tail == NULL || m_Tail->Shared != NULL || m_Tail->Size - m_Tail->End < MinSize) {
+		fifochunk_t *Chunk = AllocChunk(MinSize);
+
+		if (AllocFailed(Chunk)) {
+			*Size = 0;
+
+			return NULL;
+		}
+
+		if (m_Tail != NULL) {
+			m_Tail->Next = Chunk;
+		} else {
+			m_Head = Chunk;
+		}
+
+		m_Tail = Chunk;
+	}
+
+	*Size = m_Tail->Size - m_Tail->End;
+
+	return m_Tail->Data + m_Tail->End;
+}
+
+/**
+ * Commit
+ *
+ * Adds data which was written into the space returned by Reserve()
+ * to the buffer.
+ *
+ * @param Bytes the number of bytes
+ */
+void CFIFOBuffer::Commit(size_t Bytes) {
+	bool WasEmpty = (m_Size == 0);
 
-	char *tempBuffer = (char *)ResizeBuffer(m_Buffer, m_BufferSize,
-		m_BufferSize + Length + 2);
+	m_Tail->End += Bytes;
+	m_Size += Bytes;
 
-	if (AllocFailed(tempBuffer)) {
-		THROW(bool, Generic_OutOfMemory, "ResizeBuffer() failed.");
+	if (WasEmpty && Bytes > 0 && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
 	}
+}
 
-	m_Buffer = tempBuffer;
-	memcpy(m_Buffer + m_BufferSize, Line, Length);
-	memcpy(m_Buffer + m_BufferSize + Length, "\r\n", 2);
-	m_BufferSize += Length + 2;
+/**
+ * WriteSharedLine
+ *
+ * Queues a shared line. Short lines are copied if they fit into the
+ * partially filled last chunk; otherwise the buffer only keeps a reference
+ * to the line.
+ *
+ * @param Line the line
+ * @param Offset the number of bytes at the start of the line which are skipped
+ */
+RESULT<bool> CFIFOBuffer::WriteSharedLine(CSharedLine *Line, size_t Offset) {
+	bool WasEmpty = (m_Size == 0);
+
+	// an empty last chunk (which is kept after the buffer has been drained)
+	// would end up in front of the shared line
+	if (m_Tail != NULL && m_Tail == m_Head && m_Tail->Start == m_Tail->End) {
+		FreeChunk(m_Tail);
+
+		m_Head = NULL;
+		m_Tail = NULL;
+	}
+
+	if (m_Tail != NULL && m_Tail->Shared == NULL && m_Tail->End > 0 &&
+			m_Tail->Size - m_Tail->End >= Line->GetSize() - Offset) {
+		Append(Line->GetData() + Offset, Line->GetSize() - Offset);
+	} else {
+		fifochunk_t *Chunk = AllocSharedChunk(Line, Offset);
+
+		if (AllocFailed(Chunk)) {
+			THROW(bool, Generic_OutOfMemory, "AllocSharedChunk() failed.");
+		}
+
+		if (m_Tail != NULL) {
+			m_Tail->Next = Chunk;
+		} else {
+			m_Head = Chunk;
+		}
+
+		m_Tail = Chunk;
+		m_Size += Chunk->Size;
+	}
+
+	if (WasEmpty && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
 
 	RETURN(bool, true);
 }
@@ -213,3 +675,17 @@ RESULT<bool> CFIFOBuffer::WriteUnformattedLine(const char *Line) {
 void CFIFOBuffer::Flush(void) {
 	Read(GetSize());
 }
+
+/**
+ * SetNotifyProc
+ *
+ * Sets a function which is called whenever the buffer becomes empty or
+ * non-empty.
+ *
+ * @param NotifyProc the function (or NULL)
+ * @param Cookie a cookie which is passed to the function
+ */
+void CFIFOBuffer::SetNotifyProc(void (*NotifyProc)(void *Cookie), void *Cookie) {
+	m_NotifyProc = NotifyProc;
+	m_NotifyCookie = Cookie;
+}
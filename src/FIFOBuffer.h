@@ -1,4 +1,4 @@
-/*******************************************************************************
+/******************************************************************************
  * shroudBNC - an object-oriented framework for IRC                            *
  * Copyright (C) 2005-2014 Gunnar Beutner                                      *
  *                                                                             *
@@ -20,21 +20,75 @@
 #ifndef FIFOBUFFER_H
 #define FIFOBUFFER_H
 
-#define BLOCKSIZE 4096
+#define BLOCKSIZE 4096 /**< the size of a buffer chunk */
+#define CHUNKPOOLSIZE 256 /**< the maximum number of unused chunks which are kept for later use */
+
+/**
+ * CSharedLine
+ *
+ * An immutable, reference-counted line (including the trailing CRLF) which
+ * can be queued in several fifo buffers without copying it.
+ */
+class SBNCAPI CSharedLine {
+	unsigned int m_RefCount; /**< the number of references */
+	size_t m_Size; /**< the number of bytes */
+	size_t m_TagsLength; /**< the number of bytes which are used by the line's
+						IRCv3 tags (including the separating spaces) */
+public:
+	static CSharedLine *Create(const char *Line);
+
+	void Reference(void);
+	void Release(void);
+
+	const char *GetData(void) const;
+	size_t GetSize(void) const;
+	size_t GetTagsLength(void) const;
+};
+
+/**
+ * fifochunk_t
+ *
+ * A chunk of a fifo buffer.
+ */
+typedef struct fifochunk_s {
+	struct fifochunk_s *Next; /**< the next chunk */
+	CSharedLine *Shared; /**< the shared line the chunk refers to (or NULL
+						if the data is owned by the chunk) */
+	char *Data; /**< the chunk's data */
+	size_t Size; /**< the size of the chunk's data area */
+	size_t Start; /**< the offset of the first unread byte */
+	size_t End; /**< the offset after the last written byte */
+} fifochunk_t;
+
+/**
+ * fifosegment_t
+ *
+ * A contiguous part of a fifo buffer's data.
+ */
+typedef struct fifosegment_s {
+	char *Data; /**< the data */
+	size_t Size; /**< the number of bytes */
+} fifosegment_t;
 
 /**
  * CFIFOBuffer
  *
- * A fifo buffer.
+ * A fifo buffer. The data is stored in a list of chunks, so neither writing
+ * nor reading data has to move the data which is already in the buffer.
  */
 class SBNCAPI CFIFOBuffer {
-	char *m_Buffer; /**< the fifo buffer's data */
-	size_t m_BufferSize; /**< the size of the buffer */
-	size_t m_Offset; /**< the number of unused bytes at the
-								beginning of the buffer */
+	fifochunk_t *m_Head; /**< the first chunk */
+	fifochunk_t *m_Tail; /**< the last chunk */
+	size_t m_Size; /**< the number of bytes in the buffer */
+	void (*m_NotifyProc)(void *Cookie); /**< called when the buffer becomes
+									empty or non-empty */
+	void *m_NotifyCookie; /**< cookie for the notify function */
+
+	static fifochunk_t *AllocChunk(size_t Size);
+	static fifochunk_t *AllocSharedChunk(CSharedLine *Line, size_t Offset);
+	static void FreeChunk(fifochunk_t *Chunk);
 
-	void *ResizeBuffer(void *Buffer, size_t OldSize, size_t NewSize);
-	inline void Optimize(void);
+	bool Append(const char *Data, size_t Size);
 public:
 #ifndef SWIG
 	CFIFOBuffer(void);
@@ -43,12 +97,26 @@ public:
 
 	size_t GetSize(void) const;
 
-	char *Peek(void) const;
+	char *Peek(void);
+	char *PeekSegment(size_t *Size) const;
+	int GetSegments(fifosegment_t *Segments, int Count) const;
+	bool Find(char Character, size_t *Offset) const;
+	char *Linearize(size_t Bytes);
 	char *Read(size_t Bytes);
 	void Flush(void);
 
 	RESULT<bool> Write(const char *Data, size_t Size);
 	RESULT<bool> WriteUnformattedLine(const char *Line);
+#ifndef SWIG
+	char *Reserve(size_t MinSize, size_t *Size);
+	void Commit(size_t Bytes);
+	RESULT<bool> WriteSharedLine(CSharedLine *Line, size_t Offset = 0);
+	RESULT<bool> Write(const CFIFOBuffer *Buffer);
+#endif /* SWIG */
+
+#ifndef SWIG
+	void SetNotifyProc(void (*NotifyProc)(void *Cookie), void *Cookie);
+#endif /* SWIG */
 };
 
 #endif /* FIFOBUFFER_H */
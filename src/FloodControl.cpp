@@ -19,15 +19,96 @@
 
 #include "StdAfx.h"
 
+#define FLOODLINECOST 60000 /**< the number of tokens per line (1 token per
+							millisecond for a rate of 1 line per minute) */
+
+/**
+ * GetLineTarget
+ *
+ * Retrieves the target of a PRIVMSG or NOTICE line. Returns false for
+ * other lines.
+ *
+ * @param Line the line
+ * @param Target a buffer for the target
+ * @param Size the size of the buffer
+ */
+static bool GetLineTarget(const char *Line, char *Target, size_t Size) {
+	const char *Command = ArgStripTags(Line);
+	size_t Length;
+
+	if (*Command == ':') {
+		Command = strchr(Command, ' ');
+
+		if (Command == NULL) {
+			return false;
+		}
+
+		while (*Command == ' ') {
+			Command++;
+		}
+	}
+
+	Length = strcspn(Command, " ");
+
+	if (!(Length == 7 && strncasecmp(Command, "PRIVMSG", 7) == 0) &&
+			!(Length == 6 && strncasecmp(Command, "NOTICE", 6) == 0)) {
+		return false;
+	}
+
+	Line = Command + Length;
+
+	while (*Line == ' ') {
+		Line++;
+	}
+
+	Length = strcspn(Line, " ");
+
+	if (Length == 0) {
+		return false;
+	}
+
+	if (Length > Size - 1) {
+		Length = Size - 1;
+	}
+
+	memcpy(Target, Line, Length);
+	Target[Length] = '\0';
+
+	return true;
+}
+
 /**
  * CFloodControl
  *
  * Constructs a new flood control object.
  */
 CFloodControl::CFloodControl(void) {
-	m_BytesSent = 0;
 	m_Enabled = true;
 	m_Plugged = false;
+
+	m_Rate = FLOODRATE;
+	m_Burst = FLOODBURST;
+	m_Tokens = (mtime_t)m_Burst * FLOODLINECOST;
+	m_LastRefill = g_MonotonicTime;
+	m_RefillTimer = NULL;
+
+	m_Fairness = false;
+	m_LastTarget[0] = '\0';
+	m_TargetRun = 0;
+
+	m_NotifyProc = NULL;
+	m_NotifyCookie = NULL;
+}
+
+/**
+ * ~CFloodControl
+ *
+ * Destructs a flood control object.
+ */
+CFloodControl::~CFloodControl(void) {
+	if (m_RefillTimer != NULL) {
+		m_RefillTimer->Destroy();
+	}
 }
 
 /**
@@ -47,6 +128,113 @@ void CFloodControl::AttachInputQueue(CQueue *Queue, int Priority) {
 	m_Queues.Insert(IrcQueue);
 }
 
+/**
+ * Refill
+ *
+ * Adds the tokens which have accumulated since the last refill to the bucket.
+ */
+void CFloodControl::Refill(void) {
+	mtime_t MaxTokens = (mtime_t)m_Burst * FLOODLINECOST;
+
+	if (g_MonotonicTime > m_LastRefill) {
+		m_Tokens += (g_MonotonicTime - m_LastRefill) * m_Rate;
+	}
+
+	if (m_Tokens > MaxTokens) {
+		m_Tokens = MaxTokens;
+	}
+
+	m_LastRefill = g_MonotonicTime;
+}
+
+/**
+ * CanSend
+ *
+ * Checks whether a line can be sent right now. If the bucket doesn't have
+ * enough tokens a timer is scheduled for when the next line can be sent.
+ */
+bool CFloodControl::CanSend(void) {
+	if (!m_Enabled) {
+		return true;
+	}
+
+	if (m_Plugged) {
+		return false;
+	}
+
+	Refill();
+
+	if (m_Tokens >= FLOODLINECOST) {
+		return true;
+	}
+
+	if (m_RefillTimer == NULL) {
+		mtime_t Wait = (FLOODLINECOST - m_Tokens + m_Rate - 1) / m_Rate;
+
+		m_RefillTimer = new CTimer((unsigned int)Wait, false, FloodControlTimer, this, true);
+
+		if (AllocFailed(m_RefillTimer)) {}
+	}
+
+	return false;
+}
+
+/**
+ * SelectItem
+ *
+ * Returns the index of the item which should be sent next. Unless
+ * per-target fairness is enabled this is always the first item. Otherwise
+ * a PRIVMSG/NOTICE for another target is preferred once FLOODTARGETRUN
+ * consecutive lines for the same target have been sent. Only lines for the
+ * busy target are skipped and the search stops at the first line which
+ * doesn't have a target (e.g. MODE or KICK), so no line is ever moved past
+ * one of those.
+ *
+ * @param Queue the queue
+ */
+int CFloodControl::SelectItem(CQueue *Queue) const {
+	char Target[FLOODTARGETLEN];
+
+	if (!m_Fairness || m_TargetRun < FLOODTARGETRUN) {
+		return 0;
+	}
+
+	for (int i = 0; i < Queue->GetLength() && i < FLOODLOOKAHEAD; i++) {
+		const char *Line = Queue->PeekItem(i);
+
+		if (!GetLineTarget(Line, Target, sizeof(Target))) {
+			return 0;
+		}
+
+		if (strcasecmp(Target, m_LastTarget) != 0) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * UpdateTarget
+ *
+ * Keeps track of the number of consecutive lines for the same target.
+ *
+ * @param Line the line which is being sent
+ */
+void CFloodControl::UpdateTarget(const char *Line) {
+	char Target[FLOODTARGETLEN];
+
+	if (!GetLineTarget(Line, Target, sizeof(Target))) {
+		m_LastTarget[0] = '\0';
+		m_TargetRun = 0;
+	} else if (m_TargetRun > 0 && strcasecmp(Target, m_LastTarget) == 0) {
+		m_TargetRun++;
+	} else {
+		strmcpy(m_LastTarget, Target, sizeof(m_LastTarget));
+		m_TargetRun = 1;
+	}
+}
+
 /**
  * DequeueItem
  *
@@ -58,10 +246,6 @@ RESULT<char *> CFloodControl::DequeueItem(bool Peek) {
 	int LowestPriority = 100;
 	irc_queue_t *ThatQueue = NULL;
 
-	if (m_Enabled && m_Plugged) {
-		RETURN(char *, NULL);
-	}
-
 	for (int i = 0; i < m_Queues.GetLength(); i++) {
 		if (m_Queues[i].Priority < LowestPriority && m_Queues[i].Queue->GetLength() > 0) {
 			LowestPriority = m_Queues[i].Priority;
@@ -69,33 +253,35 @@ RESULT<char *> CFloodControl::DequeueItem(bool Peek) {
 		}
 	}
 
-	if (ThatQueue == NULL) {
+	if (ThatQueue == NULL || !CanSend()) {
 		RETURN(char *, NULL);
 	}
 
-	RESULT<const char *> PeekItem = ThatQueue->Queue->PeekItem();
-
-	if (IsError(PeekItem)) {
-		g_Bouncer->Log("PeekItem() failed.");
-
-		THROWRESULT(char *, PeekItem);
-	}
+	int Index = SelectItem(ThatQueue->Queue);
 
 	if (Peek) {
-		RETURN(char *, const_cast<char *>((const char *)PeekItem));
-	}
+		RESULT<const char *> PeekItem = ThatQueue->Queue->PeekItem(Index);
 
-	if (m_Enabled && m_BytesSent > 0 && m_BytesSent + strlen(PeekItem) + 2 + strlen(FLOODMSG) + 2 > FLOODBYTES) {
-		Plug();
+		if (IsError(PeekItem)) {
+			g_Bouncer->Log("PeekItem() failed.");
 
-		RETURN(char *, strdup(FLOODMSG));
+			THROWRESULT(char *, PeekItem);
+		}
+
+		RETURN(char *, const_cast<char *>((const char *)PeekItem));
 	}
 
-	RESULT<char *> Item = ThatQueue->Queue->DequeueItem();
+	RESULT<char *> Item = ThatQueue->Queue->DequeueItem(Index);
 
 	THROWIFERROR(char *, Item);
 
-	m_BytesSent += strlen(Item) + 2;
+	if (m_Enabled) {
+		m_Tokens -= FLOODLINECOST;
+	}
+
+	if (m_Fairness) {
+		UpdateTarget(Item);
+	}
 
 	RETURN(char *, Item);
 }
@@ -107,10 +293,11 @@ RESULT<char *> CFloodControl::DequeueItem(bool Peek) {
  * could be immediately retrieved using DequeueItem().
  */
 int CFloodControl::GetQueueSize(void) {
-	if (m_Plugged)
+	if (GetRealLength() == 0) {
 		return 0;
-	else
-		return (GetRealLength() > 0);
+	} else {
+		return CanSend() ? 1 : 0;
+	}
 }
 
 /**
@@ -154,8 +341,11 @@ void CFloodControl::Plug(void) {
  * Unplugs the queue (i.e. enables processing items).
  */
 void CFloodControl::Unplug(void) {
-	m_BytesSent = 0;
 	m_Plugged = false;
+
+	if (m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
 }
 
 /**
@@ -174,4 +364,87 @@ void CFloodControl::Enable(void) {
  */
 void CFloodControl::Disable(void) {
 	m_Enabled = false;
+
+	if (m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
+}
+
+/**
+ * SetRate
+ *
+ * Sets the rate at which lines are sent.
+ *
+ * @param Rate the number of lines per minute (0 for the default rate)
+ * @param Burst the number of lines which can be sent at once (0 for
+ *				the default burst)
+ */
+void CFloodControl::SetRate(unsigned int Rate, unsigned int Burst) {
+	Refill();
+
+	m_Rate = (Rate != 0) ? Rate : FLOODRATE;
+	m_Burst = (Burst != 0) ? Burst : FLOODBURST;
+
+	if (m_Tokens > (mtime_t)m_Burst * FLOODLINECOST) {
+		m_Tokens = (mtime_t)m_Burst * FLOODLINECOST;
+	}
+
+	// the timer is re-created for the new rate when it's needed
+	if (m_RefillTimer != NULL) {
+		m_RefillTimer->Destroy();
+		m_RefillTimer = NULL;
+
+		if (m_NotifyProc != NULL) {
+			m_NotifyProc(m_NotifyCookie);
+		}
+	}
+}
+
+/**
+ * SetFairness
+ *
+ * Sets whether lines for other targets are sent in between lines for a
+ * target which receives a lot of lines.
+ *
+ * @param Fairness a boolean flag
+ */
+void CFloodControl::SetFairness(bool Fairness) {
+	m_Fairness = Fairness;
+	m_LastTarget[0] = '\0';
+	m_TargetRun = 0;
+}
+
+/**
+ * SetNotifyProc
+ *
+ * Sets a function which is called when lines can be sent again after
+ * the flood control object has delayed them.
+ *
+ * @param NotifyProc the function (or NULL)
+ * @param Cookie a cookie which is passed to the function
+ */
+void CFloodControl::SetNotifyProc(void (*NotifyProc)(void *Cookie), void *Cookie) {
+	m_NotifyProc = NotifyProc;
+	m_NotifyCookie = Cookie;
+}
+
+/**
+ * FloodControlTimer
+ *
+ * Notifies the owner of a flood control object that the next line
+ * can be sent.
+ *
+ * @param Now the current time
+ * @param FloodControl the flood control object
+ */
+bool FloodControlTimer(time_t Now, void *FloodControl) {
+	CFloodControl *Control = (CFloodControl *)FloodControl;
+
+	Control->m_RefillTimer = NULL;
+
+	if (Control->m_NotifyProc != NULL) {
+		Control->m_NotifyProc(Control->m_NotifyCookie);
+	}
+
+	return false;
 }
@@ -20,8 +20,12 @@
 #ifndef FLOODCONTROL_H
 #define FLOODCONTROL_H
 
-#define FLOODMSG "SBNCFLOODCHECK"
-#define FLOODBYTES 1024
+#define FLOODRATE 60 /**< the default number of lines per minute */
+#define FLOODBURST 5 /**< the default number of lines which can be sent at once */
+#define FLOODTARGETRUN 3 /**< the number of consecutive lines for the same target
+						after which lines for other targets are preferred */
+#define FLOODLOOKAHEAD 32 /**< how many queued lines are searched for another target */
+#define FLOODTARGETLEN 64 /**< the maximum length of a target which is compared */
 
 /**
  * irc_queue_t
@@ -33,22 +37,48 @@ typedef struct queue_s {
 	CQueue *Queue; /**< the queue object */
 } irc_queue_t;
 
+#ifndef SWIG
+bool FloodControlTimer(time_t Now, void *FloodControl);
+#endif /* SWIG */
+
 /**
  * CFloodControl
  *
- * A queue which tries to avoid "Excess Flood" errors.
+ * A queue which tries to avoid "Excess Flood" errors. Lines are paced with
+ * a token bucket which holds up to "burst" lines and is refilled with
+ * "rate" lines per minute.
  */
 class SBNCAPI CFloodControl {
+#ifndef SWIG
+	friend bool FloodControlTimer(time_t Now, void *FloodControl);
+#endif /* SWIG */
+
 	CVector<irc_queue_t> m_Queues; /**< a list of queues which have been
 								attached to this object */
-	size_t m_BytesSent; /**< the number of bytes which have recently been sent */
 	bool m_Enabled; /**< determines whether this object is delaying the output */
 	bool m_Plugged; /**< determines whether the queue is plugged */
 
-	void ScheduleItem(void);
+	unsigned int m_Rate; /**< the number of lines per minute */
+	unsigned int m_Burst; /**< the maximum number of lines which can be sent at once */
+	mtime_t m_Tokens; /**< the bucket's tokens (in 1/60000 lines) */
+	mtime_t m_LastRefill; /**< when the bucket was last refilled (monotonic time) */
+	CTimer *m_RefillTimer; /**< timer which fires when the next line can be sent */
+
+	bool m_Fairness; /**< whether lines for different targets are interleaved */
+	char m_LastTarget[FLOODTARGETLEN]; /**< the target of the last line */
+	int m_TargetRun; /**< the number of consecutive lines for m_LastTarget */
+
+	void (*m_NotifyProc)(void *Cookie); /**< called when the next line can be sent */
+	void *m_NotifyCookie; /**< cookie for the notify function */
+
+	void Refill(void);
+	bool CanSend(void);
+	int SelectItem(CQueue *Queue) const;
+	void UpdateTarget(const char *Line);
 public:
 #ifndef SWIG
 	CFloodControl(void);
+	virtual ~CFloodControl(void);
 #endif /* SWIG */
 
 	RESULT<char *> DequeueItem(bool Peek = false);
@@ -63,6 +93,13 @@ public:
 
 	void Enable(void);
 	void Disable(void);
+
+	void SetRate(unsigned int Rate, unsigned int Burst);
+	void SetFairness(bool Fairness);
+
+#ifndef SWIG
+	void SetNotifyProc(void (*NotifyProc)(void *Cookie), void *Cookie);
+#endif /* SWIG */
 };
 
 #endif /* FLOODCONTROL_H */
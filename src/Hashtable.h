@@ -1,4 +1,4 @@
-/*******************************************************************************
+/******************************************************************************
  * shroudBNC - an object-oriented framework for IRC                            *
  * Copyright (C) 2005-2014 Gunnar Beutner                                      *
  *                                                                             *
@@ -31,19 +31,36 @@ struct hash_t {
 	Type Value; /**< the item in the hashtable */
 };
 
+typedef unsigned long hashvalue_t;
+
+#define HASHTABLE_SHORTKEY 32 /**< keys shorter than this are stored inline */
+
 /**
- * hashlist_t
+ * hashentry_t<Type>
  *
- * A bucket in a hashtable.
+ * An item in a hashtable. Items are stored in insertion order.
  */
-template <typename HashListType>
-struct SBNCAPI hashlist_t {
-	int Count;
-	char **Keys;
-	HashListType *Values;
+template <typename Type>
+struct hashentry_t {
+	hashvalue_t Hash; /**< the key's hash value */
+	char *LongKey; /**< the key if it doesn't fit into ShortKey, NULL otherwise */
+	Type Value; /**< the value */
+	bool Valid; /**< whether the item hasn't been removed */
+	char ShortKey[HASHTABLE_SHORTKEY]; /**< the key if it's short enough */
 };
 
-typedef unsigned long hashvalue_t;
+/**
+ * hashslot_t
+ *
+ * A slot in a hashtable's index.
+ */
+typedef struct hashslot_s {
+	unsigned int Hash; /**< the lower bits of the item's hash value */
+	int Entry; /**< the item's index, HASHSLOT_EMPTY or HASHSLOT_DELETED */
+} hashslot_t;
+
+#define HASHSLOT_EMPTY (-1)
+#define HASHSLOT_DELETED (-2)
 
 /**
  * DestroyObject<Type>
@@ -67,81 +84,244 @@ inline int CmpStringCase(const void *pA, const void *pB) {
 	return strcasecmp(*(const char **)pA, *(const char **)pB);
 }
 
+/**
+ * CaseFoldTable
+ *
+ * Returns a table which maps characters to their lower-case equivalents.
+ */
+inline const unsigned char *CaseFoldTable(void) {
+	static const unsigned char Table[256] = {
+		0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+		0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+		0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+		0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+		0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+		0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
+		0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
+		0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
+		0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+		0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+		0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+		0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+		0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+		0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+		0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+		0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+	};
+
+	return Table;
+}
+
+/**
+ * HashFold
+ *
+ * Calculates a hash value for a string (using the djb2 algorithm).
+ *
+ * @param String the string
+ * @param CaseMapping the case-folding table, or NULL if the hash
+ *					  value should be case-sensitive
+ */
+inline unsigned long HashFold(const char *String, const unsigned char *CaseMapping) {
+	const unsigned char *Character = (const unsigned char *)String;
+	unsigned long HashValue = 5381;
+
+	if (CaseMapping == NULL) {
+		for (; *Character != '\0'; Character++) {
+			HashValue = ((HashValue << 5) + HashValue) + *Character; /* HashValue * 33 + Character */
+		}
+	} else {
+		for (; *Character != '\0'; Character++) {
+			HashValue = ((HashValue << 5) + HashValue) + CaseMapping[*Character];
+		}
+	}
+
+	return HashValue;
+}
+
 /**
  * Hash
  *
  * Calculates a hash value for a string (using the djb2 algorithm).
  *
  * @param String the string
+ * @param CaseSensitive whether the hash value should be case-sensitive
  */
 inline unsigned long Hash(const char *String, bool CaseSensitive) {
-	unsigned long HashValue = 5381;
-	int Character;
+	return HashFold(String, CaseSensitive ? NULL : CaseFoldTable());
+}
+
+/**
+ * CompareFold
+ *
+ * Checks whether two strings are equal.
+ *
+ * @param A the first string
+ * @param B the second string
+ * @param CaseMapping the case-folding table, or NULL if the comparison
+ *					  should be case-sensitive
+ */
+inline bool CompareFold(const char *A, const char *B, const unsigned char *CaseMapping) {
+	const unsigned char *pA = (const unsigned char *)A;
+	const unsigned char *pB = (const unsigned char *)B;
+
+	if (CaseMapping == NULL) {
+		return (strcmp(A, B) == 0);
+	}
 
-	while ((Character = *(String++)) != '\0') {
-		if (!CaseSensitive) {
-			Character = tolower(Character);
+	while (CaseMapping[*pA] == CaseMapping[*pB]) {
+		if (*pA == '\0') {
+			return true;
 		}
 
-		HashValue = ((HashValue << 5) + HashValue) + Character; /* HashValue * 33 + Character */
+		pA++;
+		pB++;
 	}
 
-	return HashValue;
+	return false;
+}
+
+/**
+ * HashCompare
+ *
+ * Checks whether two strings are equal.
+ *
+ * @param A the first string
+ * @param B the second string
+ * @param CaseSensitive whether the comparison should be case-sensitive
+ */
+inline bool HashCompare(const char *A, const char *B, bool CaseSensitive) {
+	return CompareFold(A, B, CaseSensitive ? NULL : CaseFoldTable());
 }
 
+template<typename Type, bool CaseSensitive>
+class CHashtableCursor;
+
+/**
+ * CHashtable<Type, CaseSensitive>
+ *
+ * A hashtable which maps strings to values. Items are kept in an array
+ * (in insertion order) and are looked up using an open-addressing index
+ * which stores the items' hash values.
+ */
 template<typename Type, bool CaseSensitive>
 class CHashtable {
 private:
-	hashlist_t<Type> *m_Buckets; /**< used for storing the items of the hashtable */
-	int m_BucketCount; /** bucket count */
+	friend class CHashtableCursor<Type, CaseSensitive>;
+
+	hashentry_t<Type> *m_Entries; /**< the items */
+	int m_EntryCount; /**< number of used items (including removed items) */
+	int m_EntryAlloc; /**< number of allocated items */
+	hashslot_t *m_Slots; /**< the index */
+	int m_SlotCount; /**< number of slots in the index, always a power of two */
+	int m_DeletedSlots; /**< number of deleted slots in the index */
 	void (*m_DestructorFunc)(Type Object); /**< the function which should be used for destroying items */
 	int m_LengthCache; /**< (cached) number of items in the hashtable */
+	mutable unsigned int m_Locks; /**< number of cursors which are iterating over the hashtable */
+	mutable int m_IterateIndex; /**< the index of the last item returned by Iterate() */
+	mutable int m_IterateEntry; /**< the last item returned by Iterate() */
+	mutable hash_t<Type> m_IterateItem; /**< the last item returned by Iterate() */
+	const unsigned char *m_CaseMapping; /**< the case-folding table for keys, NULL for case-sensitive hashtables */
+
+	/**
+	 * GetKey
+	 *
+	 * Returns an item's key.
+	 *
+	 * @param Entry the item
+	 */
+	static char *GetKey(hashentry_t<Type> *Entry) {
+		return (Entry->LongKey != NULL) ? Entry->LongKey : Entry->ShortKey;
+	}
 
 	/**
-	 * Rehash
+	 * FindSlot
 	 *
-	 * Increases the bucket count and rehashes the hashtable.
+	 * Returns the index slot for a key or NULL if there is no such item.
+	 *
+	 * @param Key the key
+	 * @param HashValue the key's hash value
 	 */
-	void Rehash(void) {
-		hashlist_t<Type> *OldBuckets;
-		int OldBucketCount;
+	hashslot_t *FindSlot(const char *Key, hashvalue_t HashValue) const {
+		unsigned int Mask = m_SlotCount - 1;
 
-		OldBuckets = m_Buckets;
-		OldBucketCount = m_BucketCount;
+		for (unsigned int i = HashValue & Mask; ; i = (i + 1) & Mask) {
+			hashslot_t *Slot = &m_Slots[i];
 
-		m_BucketCount *= 2;
-		m_Buckets = (hashlist_t<Type> *)malloc(sizeof(hashlist_t<Type>) * m_BucketCount);
+			if (Slot->Entry == HASHSLOT_EMPTY) {
+				return NULL;
+			}
 
-		if (m_Buckets == NULL) {
-			m_Buckets = OldBuckets;
-			m_BucketCount /= 2;
+			if (Slot->Entry >= 0 && Slot->Hash == (unsigned int)HashValue &&
+					CompareFold(GetKey(&m_Entries[Slot->Entry]), Key, m_CaseMapping)) {
+				return Slot;
+			}
+		}
+	}
 
-			return;
+	/**
+	 * Rebuild
+	 *
+	 * Rebuilds the index. Unless there are active cursors, removed items
+	 * are discarded.
+	 *
+	 * @param SlotCount the new number of slots
+	 */
+	bool Rebuild(int SlotCount) {
+		hashslot_t *Slots;
+		unsigned int Mask = SlotCount - 1;
+
+		Slots = (hashslot_t *)malloc(sizeof(hashslot_t) * SlotCount);
+
+		if (Slots == NULL) {
+			return false;
 		}
 
-		m_LengthCache = 0;
+		memset(Slots, 0xff, sizeof(hashslot_t) * SlotCount);
 
-		memset(m_Buckets, 0, sizeof(hashlist_t<Type>) * m_BucketCount);
+		if (m_Locks == 0) {
+			int Count = 0;
 
-		for (int i = 0; i < OldBucketCount; i++) {
-			hashlist_t<Type> *List = &OldBuckets[i];
+			for (int i = 0; i < m_EntryCount; i++) {
+				if (m_Entries[i].Valid) {
+					if (Count != i) {
+						m_Entries[Count] = m_Entries[i];
+					}
 
-			for (int a = 0; a < List->Count; a++) {
-				if (!Add(List->Keys[a], List->Values[a])) {
-					abort();
+					Count++;
 				}
+			}
 
-				free(List->Keys[a]);
+			m_EntryCount = Count;
+			m_IterateIndex = -1;
+		}
+
+		for (int i = 0; i < m_EntryCount; i++) {
+			if (!m_Entries[i].Valid) {
+				continue;
+			}
+
+			unsigned int a = m_Entries[i].Hash & Mask;
+
+			while (Slots[a].Entry != HASHSLOT_EMPTY) {
+				a = (a + 1) & Mask;
 			}
 
-			free(List->Keys);
-			free(List->Values);
+			Slots[a].Hash = (unsigned int)m_Entries[i].Hash;
+			Slots[a].Entry = i;
 		}
 
-		free(OldBuckets);
+		free(m_Slots);
+
+		m_Slots = Slots;
+		m_SlotCount = SlotCount;
+		m_DeletedSlots = 0;
+
+		return true;
 	}
 
 public:
+	typedef class CHashtableCursor<Type, CaseSensitive> Cursor;
+
 #ifndef SWIG
 	/**
 	 * CHashtable
@@ -149,18 +329,28 @@ public:
 	 * Constructs an empty hashtable.
 	 */
 	CHashtable(void) {
-		m_BucketCount = 32;
-		m_Buckets = (hashlist_t<Type> *)malloc(sizeof(hashlist_t<Type>) * m_BucketCount);
+		m_Entries = NULL;
+		m_EntryCount = 0;
+		m_EntryAlloc = 0;
+
+		m_SlotCount = 16;
+		m_Slots = (hashslot_t *)malloc(sizeof(hashslot_t) * m_SlotCount);
 
-		if (m_Buckets == NULL) {
+		if (m_Slots == NULL) {
 			abort();
 		}
 
-		memset(m_Buckets, 0, sizeof(hashlist_t<Type>) * m_BucketCount);
+		memset(m_Slots, 0xff, sizeof(hashslot_t) * m_SlotCount);
+
+		m_DeletedSlots = 0;
 
 		m_DestructorFunc = NULL;
 
 		m_LengthCache = 0;
+		m_Locks = 0;
+		m_IterateIndex = -1;
+
+		m_CaseMapping = CaseSensitive ? NULL : CaseFoldTable();
 	}
 
 	/**
@@ -171,8 +361,8 @@ public:
 	~CHashtable(void) {
 		Clear();
 
-
-		free(m_Buckets);
+		free(m_Entries);
+		free(m_Slots);
 	}
 #endif /*SWIG */
 	/**
@@ -181,24 +371,32 @@ public:
 	 * Removes all items from the hashtable.
 	 */
 	void Clear(void) {
-		for (int i = 0; i < m_BucketCount; i++) {
-			hashlist_t<Type> *List = &m_Buckets[i];
+		hashentry_t<Type> *Entries = m_Entries;
+		int Count = m_EntryCount;
 
-			for (int a = 0; a < List->Count; a++) {
-				free(List->Keys[a]);
+		// the value destructor might modify the hashtable
+		m_Entries = NULL;
+		m_EntryCount = 0;
+		m_EntryAlloc = 0;
+		m_LengthCache = 0;
+		m_DeletedSlots = 0;
+		m_IterateIndex = -1;
 
-				if (m_DestructorFunc != NULL) {
-					m_DestructorFunc(List->Values[a]);
-				}
+		memset(m_Slots, 0xff, sizeof(hashslot_t) * m_SlotCount);
+
+		for (int i = 0; i < Count; i++) {
+			if (!Entries[i].Valid) {
+				continue;
 			}
 
-			free(List->Keys);
-			free(List->Values);
-		}
+			free(Entries[i].LongKey);
 
-		memset(m_Buckets, 0, sizeof(hashlist_t<Type>) * m_BucketCount);
+			if (m_DestructorFunc != NULL) {
+				m_DestructorFunc(Entries[i].Value);
+			}
+		}
 
-		m_LengthCache = 0;
+		free(Entries);
 	}
 
 	/**
@@ -210,10 +408,11 @@ public:
 	 * @param Value the item
 	 */
 	RESULT<bool> Add(const char *Key, Type Value) {
-		char *dupKey;
-		char **newKeys;
-		Type *newValues;
-		hashlist_t<Type> *List;
+		hashentry_t<Type> *Entry;
+		hashvalue_t HashValue;
+		size_t Length;
+		unsigned int Mask;
+		unsigned int i;
 
 		if (Key == NULL) {
 			THROW(bool, Generic_InvalidArgument, "Key cannot be NULL.");
@@ -222,75 +421,100 @@ public:
 		// Remove any existing item which has the same key
 		Remove(Key);
 
-		List = &m_Buckets[Hash(Key, CaseSensitive) % m_BucketCount];
+		// discard removed items before growing the list of items
+		if (m_EntryCount == m_EntryAlloc && m_Locks == 0 && m_EntryCount - m_LengthCache > m_EntryCount / 4) {
+			if (!Rebuild(m_SlotCount)) {
+				THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+			}
+		}
 
-		dupKey = strdup(Key);
+		// keep the index at most half full
+		if ((m_LengthCache + m_DeletedSlots + 1) * 2 > m_SlotCount) {
+			int SlotCount = m_SlotCount;
 
-		if (dupKey == NULL) {
-			THROW(bool, Generic_OutOfMemory, "strdup() failed.");
+			while ((m_LengthCache + 1) * 2 > SlotCount) {
+				SlotCount *= 2;
+			}
+
+			if (!Rebuild(SlotCount)) {
+				THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+			}
 		}
 
-		newKeys = (char **)realloc(List->Keys, (List->Count + 1) * sizeof(char *));
+		if (m_EntryCount == m_EntryAlloc) {
+			int NewAlloc = (m_EntryAlloc == 0) ? 4 : m_EntryAlloc * 2;
+			hashentry_t<Type> *NewEntries;
 
-		if (newKeys == NULL) {
-			free(dupKey);
+			NewEntries = (hashentry_t<Type> *)realloc(m_Entries, sizeof(hashentry_t<Type>) * NewAlloc);
 
-			THROW(bool, Generic_OutOfMemory, "realloc() failed.");
+			if (NewEntries == NULL) {
+				THROW(bool, Generic_OutOfMemory, "realloc() failed.");
+			}
+
+			m_Entries = NewEntries;
+			m_EntryAlloc = NewAlloc;
 		}
 
-		List->Keys = newKeys;
+		Entry = &m_Entries[m_EntryCount];
 
-		newValues = (Type *)realloc(List->Values, (List->Count + 1) * sizeof(Type));
+		Length = strlen(Key);
 
-		if (newValues == NULL) {
-			free(dupKey);
+		if (Length < sizeof(Entry->ShortKey)) {
+			memcpy(Entry->ShortKey, Key, Length + 1);
+			Entry->LongKey = NULL;
+		} else {
+			Entry->LongKey = strdup(Key);
 
-			THROW(bool, Generic_OutOfMemory, "realloc() failed.");
+			if (Entry->LongKey == NULL) {
+				THROW(bool, Generic_OutOfMemory, "strdup() failed.");
+			}
 		}
 
-		List->Count++;
+		HashValue = HashFold(Key, m_CaseMapping);
 
-		List->Values = newValues;
+		Entry->Hash = HashValue;
+		Entry->Value = Value;
+		Entry->Valid = true;
 
-		List->Keys[List->Count - 1] = dupKey;
-		List->Values[List->Count -1] = Value;
+		Mask = m_SlotCount - 1;
 
-		m_LengthCache++;
+		for (i = HashValue & Mask; m_Slots[i].Entry >= 0; i = (i + 1) & Mask)
+			; /* empty */
 
-		if (List->Count > 3) {
-			Rehash();
+		if (m_Slots[i].Entry == HASHSLOT_DELETED) {
+			m_DeletedSlots--;
 		}
 
+		m_Slots[i].Hash = (unsigned int)HashValue;
+		m_Slots[i].Entry = m_EntryCount;
+
+		m_EntryCount++;
+		m_LengthCache++;
+
 		RETURN(bool, true);
 	}
 
 	/**
 	 * Get
 	 *
-	 * Returns the item which is associated to a key or NULL if
-	 * there is no such item.
+	 * Returns the item which is associated to a key or a value-initialized
+	 * item (i.e. NULL for pointers) if there is no such item.
 	 *
 	 * @param Key the key
 	 */
 	Type Get(const char *Key) const {
-		const hashlist_t<Type> *List;
+		hashslot_t *Slot;
 
 		if (Key == NULL) {
-			return NULL;
+			return Type();
 		}
 
-		List = &m_Buckets[Hash(Key, CaseSensitive) % m_BucketCount];
+		Slot = FindSlot(Key, HashFold(Key, m_CaseMapping));
 
-		if (List->Count == 0) {
-			return NULL;
+		if (Slot == NULL) {
+			return Type();
 		} else {
-			for (int i = 0; i < List->Count; i++) {
-				if (List->Keys[i] && (CaseSensitive ? strcmp(List->Keys[i], Key) : strcasecmp(List->Keys[i], Key)) == 0) {
-					return List->Values[i];
-				}
-			}
-
-			return NULL;
+			return m_Entries[Slot->Entry].Value;
 		}
 	}
 
@@ -304,49 +528,40 @@ public:
 	 *					  is going to be called for the item
 	 */
 	RESULT<bool> Remove(const char *Key, bool DontDestroy = false) {
-		hashlist_t<Type> *List;
+		hashentry_t<Type> *Entry;
+		hashslot_t *Slot;
+		Type Value;
 
 		if (Key == NULL) {
 			THROW(bool, Generic_InvalidArgument, "Key cannot be NULL.");
 		}
 
-		List = &m_Buckets[Hash(Key, CaseSensitive) % m_BucketCount];
+		Slot = FindSlot(Key, HashFold(Key, m_CaseMapping));
 
-		if (List->Count == 0) {
+		if (Slot == NULL) {
 			RETURN(bool, true);
-		} else if (List->Count == 1 && (CaseSensitive ? strcmp(List->Keys[0], Key) : strcasecmp(List->Keys[0], Key)) == 0) {
-			if (m_DestructorFunc != NULL && DontDestroy == false) {
-				m_DestructorFunc(List->Values[0]);
-			}
-
-			free(List->Keys[0]);
-
-			free(List->Keys);
-			free(List->Values);
-			List->Count = 0;
-			List->Keys = NULL;
-			List->Values = NULL;
+		}
 
-			m_LengthCache--;
-		} else {
-			for (int i = 0; i < List->Count; i++) {
-				if (List->Keys[i] && (CaseSensitive ? strcmp(List->Keys[i], Key) : strcasecmp(List->Keys[i], Key)) == 0) {
-					free(List->Keys[i]);
+		Entry = &m_Entries[Slot->Entry];
+		Value = Entry->Value;
 
-					List->Keys[i] = List->Keys[List->Count - 1];
+		Slot->Entry = HASHSLOT_DELETED;
+		m_DeletedSlots++;
 
-					if (m_DestructorFunc != NULL && DontDestroy == false) {
-						m_DestructorFunc(List->Values[i]);
-					}
+		Entry->Valid = false;
+		free(Entry->LongKey);
+		Entry->LongKey = NULL;
 
-					List->Values[i] = List->Values[List->Count - 1];
-					List->Count--;
+		m_LengthCache--;
+		m_IterateIndex = -1;
 
-					m_LengthCache--;
+		// removed items at the end of the list can be reused right away
+		while (m_Locks == 0 && m_EntryCount > 0 && !m_Entries[m_EntryCount - 1].Valid) {
+			m_EntryCount--;
+		}
 
-					break;
-				}
-			}
+		if (m_DestructorFunc != NULL && DontDestroy == false) {
+			m_DestructorFunc(Value);
 		}
 
 		RETURN(bool, true);
@@ -372,56 +587,84 @@ public:
 		m_DestructorFunc = Func;
 	}
 
+	/**
+	 * SetCaseMapping
+	 *
+	 * Sets the case-folding table which is used for comparing the keys
+	 * of a case-insensitive hashtable (e.g. one returned by GetCaseMapping()).
+	 *
+	 * @param CaseMapping the case-folding table
+	 */
+	void SetCaseMapping(const unsigned char *CaseMapping) {
+		if (CaseSensitive || CaseMapping == NULL || CaseMapping == m_CaseMapping) {
+			return;
+		}
+
+		m_CaseMapping = CaseMapping;
+
+		for (int i = 0; i < m_EntryCount; i++) {
+			if (m_Entries[i].Valid) {
+				m_Entries[i].Hash = HashFold(GetKey(&m_Entries[i]), m_CaseMapping);
+			}
+		}
+
+		if (!Rebuild(m_SlotCount)) {
+			abort();
+		}
+	}
+
+	/**
+	 * GetCaseMapping
+	 *
+	 * Returns the case-folding table for the hashtable's keys.
+	 */
+	const unsigned char *GetCaseMapping(void) const {
+		return m_CaseMapping;
+	}
+
 	/**
 	 * Iterate
 	 *
-	 * Returns the Index-th item of the hashtable.
+	 * Returns the Index-th item of the hashtable. Sequential calls
+	 * (i.e. with Index + 1) are O(1), anything else might have to scan the
+	 * hashtable. New code should use CHashtableCursor instead.
 	 *
 	 * @param Index the index
 	 */
 	hash_t<Type> *Iterate(int Index) const {
-		static void *thisPointer = NULL;
-		static int cache_Index = 0, cache_i = 0, cache_a = 0;
 		int Skip = 0;
-		int i, a;
-		bool first = true;
+		int i = 0;
 
-		if (thisPointer == this && cache_Index == Index - 1) {
-			i = cache_i;
-			a = cache_a;
-			Skip = cache_Index;
-		} else {
-			i = 0;
-			a = 0;
+		if (Index < 0 || Index >= m_LengthCache) {
+			return NULL;
 		}
 
-		for (; i < m_BucketCount; i++) {
-			if (!first) {
-				a = 0;
-			} else {
-				first = false;
+		if (m_EntryCount == m_LengthCache) {
+			i = Index;
+		} else {
+			if (m_IterateIndex != -1 && m_IterateIndex == Index - 1) {
+				i = m_IterateEntry + 1;
+				Skip = Index;
 			}
 
-			for (;a < m_Buckets[i].Count; a++) {
-				if (Skip == Index) {
-					static hash_t<Type> Item;
-
-					Item.Name = m_Buckets[i].Keys[a];
-					Item.Value = m_Buckets[i].Values[a];
-
-					cache_Index = Index;
-					cache_i = i;
-					cache_a = a;
-					thisPointer = (void *)this;
+			for (; i < m_EntryCount; i++) {
+				if (m_Entries[i].Valid) {
+					if (Skip == Index) {
+						break;
+					}
 
-					return &Item;
+					Skip++;
 				}
-
-				Skip++;
 			}
 		}
 
-		return NULL;
+		m_IterateItem.Name = GetKey(&m_Entries[i]);
+		m_IterateItem.Value = m_Entries[i].Value;
+
+		m_IterateIndex = Index;
+		m_IterateEntry = i;
+
+		return &m_IterateItem;
 	}
 
 	/**
@@ -431,25 +674,19 @@ public:
 	 * will eventually have to be passed to free().
 	 */
 	char **GetSortedKeys(void) const {
-		char **NewKeys, **Keys = NULL;
+		char **Keys;
 		int Count = 0;
 
-		for (int i = 0; i < m_BucketCount; i++) {
-			NewKeys = (char **)realloc(Keys, (Count + m_Buckets[i].Count) * sizeof(char *));
-
-			if (Count + m_Buckets[i].Count > 0 && NewKeys == NULL) {
-				free(Keys);
+		Keys = (char **)malloc((m_LengthCache + 1) * sizeof(char *));
 
-				return NULL;
-			}
-
-			Keys = NewKeys;
+		if (Keys == NULL) {
+			return NULL;
+		}
 
-			for (int a = 0; a < m_Buckets[i].Count; a++) {
-				Keys[Count + a] = m_Buckets[i].Keys[a];
+		for (int i = 0; i < m_EntryCount; i++) {
+			if (m_Entries[i].Valid) {
+				Keys[Count++] = GetKey(&m_Entries[i]);
 			}
-
-			Count += m_Buckets[i].Count;
 		}
 
 		assert(Count == m_LengthCache);
@@ -458,15 +695,115 @@ public:
 			qsort(Keys, Count, sizeof(Keys[0]), CmpStringCase);
 		}
 
-		Keys = (char **)realloc(Keys, ++Count * sizeof(char *));
+		Keys[Count] = NULL;
 
-		if (Keys == NULL) {
-			return NULL;
+		return Keys;
+	}
+};
+
+/**
+ * CHashtableCursor
+ *
+ * Used for iterating over CHashtable objects. While a cursor is active
+ * removed items aren't discarded, so items can be added and removed
+ * without invalidating the cursor's position.
+ */
+template<typename Type, bool CaseSensitive>
+class CHashtableCursor {
+private:
+	const CHashtable<Type, CaseSensitive> *m_Table; /**< the hashtable */
+	int m_Entry; /**< the current item */
+	hash_t<Type> m_Item; /**< the current item */
+
+	/**
+	 * Seek
+	 *
+	 * Moves the cursor to the next item, starting at the current position.
+	 */
+	void Seek(void) {
+		while (m_Entry < m_Table->m_EntryCount) {
+			hashentry_t<Type> *Entry = &m_Table->m_Entries[m_Entry];
+
+			if (Entry->Valid) {
+				m_Item.Name = CHashtable<Type, CaseSensitive>::GetKey(Entry);
+				m_Item.Value = Entry->Value;
+
+				return;
+			}
+
+			m_Entry++;
 		}
+	}
 
-		Keys[Count - 1] = NULL;
+public:
+	/**
+	 * CHashtableCursor
+	 *
+	 * Initializes a new cursor.
+	 *
+	 * @param Table the hashtable
+	 */
+	explicit CHashtableCursor(const CHashtable<Type, CaseSensitive> *Table) {
+		m_Table = Table;
+		m_Table->m_Locks++;
 
-		return Keys;
+		m_Entry = 0;
+
+		m_Item.Name = NULL;
+		m_Item.Value = Type();
+
+		Seek();
+	}
+
+	/**
+	 * ~CHashtableCursor
+	 *
+	 * Destroys a cursor.
+	 */
+	~CHashtableCursor(void) {
+		m_Table->m_Locks--;
+	}
+
+	/**
+	 * operator *
+	 *
+	 * Retrieves the current item.
+	 */
+	hash_t<Type>& operator *(void) {
+		return m_Item;
+	}
+
+	/**
+	 * operator ->
+	 *
+	 * Retrieves the current item.
+	 */
+	hash_t<Type>* operator ->(void) {
+		return &m_Item;
+	}
+
+	/**
+	 * Proceed
+	 *
+	 * Proceeds to the next item.
+	 */
+	void Proceed(void) {
+		if (!IsValid()) {
+			return;
+		}
+
+		m_Entry++;
+
+		Seek();
+	}
+
+	/**
+	 * IsValid
+	 *
+	 * Checks whether the end of the hashtable has been reached.
+	 */
+	bool IsValid(void) const {
+		return (m_Entry < m_Table->m_EntryCount);
 	}
 };
 
@@ -504,7 +841,7 @@ public:
 		if (m_Hash != Other.m_Hash) {
 			return false;
 		} else {
-			return (strcasecmp(m_String, Other.m_String) == 0);
+			return HashCompare(m_String, Other.m_String, false);
 		}
 	}
 };
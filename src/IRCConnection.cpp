@@ -58,6 +58,8 @@ CIRCConnection::CIRCConnection(const char *Host, unsigned int Port, CUser *Owner
 	m_Site = NULL;
 	m_Usermodes = NULL;
 	m_EatPong = false;
+	m_MessageTags = false;
+	m_CurrentTags = NULL;
 
 	m_QueueHigh = new CQueue();
 
@@ -90,6 +92,9 @@ CIRCConnection::CIRCConnection(const char *Host, unsigned int Port, CUser *Owner
 			WriteLine("PASS :%s", Password);
 		}
 
+		// servers which don't support CAP ignore this (the 421 reply is
+		// not forwarded to clients)
+		WriteLine("CAP REQ :message-tags");
 		WriteLine("NICK %s", Owner->GetNick());
 
 		if (Owner->GetIdent() != NULL) {
@@ -122,10 +127,20 @@ CIRCConnection::CIRCConnection(const char *Host, unsigned int Port, CUser *Owner
 	m_ISupport->Add("PREFIX", strdup("(ov)@+"));
 	m_ISupport->Add("NAMESX", strdup(""));
 
+	UpdateCaseMapping();
+
 	m_FloodControl->AttachInputQueue(m_QueueHigh, 0);
 	m_FloodControl->AttachInputQueue(m_QueueMiddle, 1);
 	m_FloodControl->AttachInputQueue(m_QueueLow, 2);
 
+	m_QueueHigh->SetNotifyProc(ConnectionQueueChanged, static_cast<CConnection *>(this));
+	m_QueueMiddle->SetNotifyProc(ConnectionQueueChanged, static_cast<CConnection *>(this));
+	m_QueueLow->SetNotifyProc(ConnectionQueueChanged, static_cast<CConnection *>(this));
+
+	m_FloodControl->SetRate(Owner->GetFloodRate(), Owner->GetFloodBurst());
+	m_FloodControl->SetFairness(Owner->GetFloodFairness());
+	m_FloodControl->SetNotifyProc(ConnectionQueueChanged, static_cast<CConnection *>(this));
+
 	m_PingTimer = g_Bouncer->CreateTimer(180, true, IRCPingTimer, this);
 	m_DelayJoinTimer = NULL;
 	m_NickCatchTimer = NULL;
@@ -190,7 +205,7 @@ bool CIRCConnection::ParseLineArgV(int argc, const char **argv) {
 	const char *Reply = argv[0];
 	const char *Raw = argv[1];
 	char *Nick = ::NickFromHostmask(Reply);
-	int iRaw = atoi(Raw);
+	int Command = GetIRCCommand(Raw);
 
 	bool b_Me = false;
 	if (m_CurrentNick != NULL && Nick != NULL && strcasecmp(Nick, m_CurrentNick) == 0) {
@@ -201,571 +216,730 @@ bool CIRCConnection::ParseLineArgV(int argc, const char **argv) {
 
 	Client = GetOwner()->GetClientConnectionMultiplexer();
 
-	// HASH values
-	CHashCompare hashRaw(argv[1]);
-	static CHashCompare hashPrivmsg("PRIVMSG");
-	static CHashCompare hashNotice("NOTICE");
-	static CHashCompare hashJoin("JOIN");
-	static CHashCompare hashPart("PART");
-	static CHashCompare hashKick("KICK");
-	static CHashCompare hashNick("NICK");
-	static CHashCompare hashQuit("QUIT");
-	static CHashCompare hashMode("MODE");
-	static CHashCompare hashTopic("TOPIC");
-	static CHashCompare hashPong("PONG");
-	// END of HASH values
-
-	if (argc > 6 && iRaw == 4) {
-		free(m_Server);
-		m_Server = strdup(argv[3]);
-
-                free(m_ServerVersion);
-                m_ServerVersion = strdup(argv[4]);
-
-		free(m_ServerUserModes);
-		m_ServerUserModes = strdup(argv[5]);
-
-		free(m_ServerChanModes);
-		m_ServerChanModes = strdup(argv[6]);
-	} else if (argc > 3 && iRaw == 433) {
-		bool ReturnValue = ModuleEvent(argc, argv);
-
-		if (ReturnValue) {
-			if (GetCurrentNick() == NULL) {
-				WriteLine("NICK :%s_", argv[3]);
-			}
+	switch (Command) {
+		case 4:
+			if (argc > 6) {
+				free(m_Server);
+				m_Server = strdup(argv[3]);
+
+				free(m_ServerVersion);
+				m_ServerVersion = strdup(argv[4]);
 
-			if (m_NickCatchTimer == NULL) {
-				m_NickCatchTimer = new CTimer(30, false, NickCatchTimer, this);
+				free(m_ServerUserModes);
+				m_ServerUserModes = strdup(argv[5]);
+
+				free(m_ServerChanModes);
+				m_ServerChanModes = strdup(argv[6]);
 			}
-		}
 
-		return ReturnValue;
-	} else if (argc > 3 && hashRaw == hashPrivmsg && Client == NULL) {
-		const char *Host;
-		const char *Dest = argv[2];
-		char *Nick = ::NickFromHostmask(Reply);
+			break;
 
-		Channel = GetChannel(Dest);
+		case 433:
+			if (argc > 3) {
+				bool ReturnValue = ModuleEvent(argc, argv);
+
+				if (ReturnValue) {
+					if (GetCurrentNick() == NULL) {
+						WriteLine("NICK :%s_", argv[3]);
+					}
 
-		if (Channel != NULL) {
-			CNick *User = Channel->GetNames()->Get(Nick);
+					if (m_NickCatchTimer == NULL) {
+						m_NickCatchTimer = new CTimer(30, false, NickCatchTimer, this);
+					}
+				}
 
-			if (User != NULL) {
-				User->SetIdleSince(g_CurrentTime);
+				return ReturnValue;
 			}
 
-			Channel->AddBacklogLine(argv[0], argv[3]);
-		}
+			break;
 
-		if (!ModuleEvent(argc, argv)) {
-			free(Nick);
-			return false;
-		}
+		case IRCCommand_Privmsg:
+			if (argc > 3 && Client == NULL) {
+				const char *Host;
+				const char *Dest = argv[2];
+				char *Nick = ::NickFromHostmask(Reply);
+
+				Channel = GetChannel(Dest);
+
+				if (Channel != NULL) {
+					CNick *User = Channel->GetNames()->Get(Nick);
+
+					if (User != NULL) {
+						User->SetIdleSince(g_CurrentTime);
+					}
 
-		/* don't log ctcp requests */
-		if (argv[3][0] != '\1' && argv[3][strlen(argv[3]) - 1] != '\1' && Dest != NULL &&
-				Nick != NULL && m_CurrentNick != NULL && strcasecmp(Dest, m_CurrentNick) == 0 &&
-				strcasecmp(Nick, m_CurrentNick) != 0) {
-			char *Dup;
-			char *Delim;
+					Channel->AddBacklogLine(argv[0], argv[3]);
+				}
+
+				if (!ModuleEvent(argc, argv)) {
+					free(Nick);
+					return false;
+				}
+
+				/* don't log ctcp requests */
+				if (argv[3][0] != '\1' && argv[3][strlen(argv[3]) - 1] != '\1' && Dest != NULL &&
+						Nick != NULL && m_CurrentNick != NULL && strcasecmp(Dest, m_CurrentNick) == 0 &&
+						strcasecmp(Nick, m_CurrentNick) != 0) {
+					char *Dup;
+					char *Delim;
+
+					Dup = strdup(Reply);
+
+					if (AllocFailed(Dup)) {
+						free(Nick);
+
+						return true;
+					}
 
-			Dup = strdup(Reply);
+					Delim = strchr(Dup, '!');
+
+					if (Delim != NULL) {
+						*Delim = '\0';
+
+						Host = Delim + 1;
+					}
+
+					GetOwner()->Log("%s (%s): %s", Dup, Delim ? Host : "<unknown host>", argv[3]);
+
+					free(Dup);
+				}
 
-			if (AllocFailed(Dup)) {
 				free(Nick);
 
+				UpdateHostHelper(Reply);
+
 				return true;
+			} else if (argc > 3 && Client != NULL) {
+				Channel = GetChannel(argv[2]);
+
+				if (Channel != NULL) {
+					Channel->AddBacklogLine(argv[0], argv[3]);
+				}
 			}
 
-			Delim = strchr(Dup, '!');
+			break;
 
-			if (Delim != NULL) {
-				*Delim = '\0';
+		case IRCCommand_Notice:
+			if (argc > 3 && Client == NULL) {
+				const char *Dest = argv[2];
+				char *Nick;
+		
+				if (!ModuleEvent(argc, argv)) {
+					return false;
+				}
 
-				Host = Delim + 1;
-			}
+				Nick = ::NickFromHostmask(Reply);
 
-			GetOwner()->Log("%s (%s): %s", Dup, Delim ? Host : "<unknown host>", argv[3]);
+				/* don't log ctcp replies */
+				if (argv[3][0] != '\1' && argv[3][strlen(argv[3]) - 1] != '\1' && Dest != NULL &&
+						Nick != NULL && m_CurrentNick != NULL && strcasecmp(Dest, m_CurrentNick) == 0 &&
+						strcasecmp(Nick, m_CurrentNick) != 0) {
+					GetOwner()->Log("%s (notice): %s", Reply, argv[3]);
+				}
 
-			free(Dup);
-		}
+				free(Nick);
 
-		free(Nick);
+				return true;
+			}
 
-		UpdateHostHelper(Reply);
+			break;
 
-		return true;
-	} else if (argc > 3 && hashRaw == hashPrivmsg && Client != NULL) {
-		Channel = GetChannel(argv[2]);
+		case IRCCommand_Join:
+			if (argc > 2) {
+				if (b_Me) {
+					AddChannel(argv[2]);
 
-		if (Channel != NULL) {
-			Channel->AddBacklogLine(argv[0], argv[3]);
-		}
-	} else if (argc > 3 && hashRaw == hashNotice && Client == NULL) {
-		const char *Dest = argv[2];
-		char *Nick;
-		
-		if (!ModuleEvent(argc, argv)) {
-			return false;
-		}
+					/* GetOwner() can be NULL if AddChannel failed */
+					if (GetOwner() != NULL && Client == NULL) {
+						WriteLine("MODE %s", argv[2]);
+					}
+				}
 
-		Nick = ::NickFromHostmask(Reply);
+				Channel = GetChannel(argv[2]);
 
-		/* don't log ctcp replies */
-		if (argv[3][0] != '\1' && argv[3][strlen(argv[3]) - 1] != '\1' && Dest != NULL &&
-				Nick != NULL && m_CurrentNick != NULL && strcasecmp(Dest, m_CurrentNick) == 0 &&
-				strcasecmp(Nick, m_CurrentNick) != 0) {
-			GetOwner()->Log("%s (notice): %s", Reply, argv[3]);
-		}
+				if (Channel != NULL) {
+					Nick = NickFromHostmask(Reply);
 
-		free(Nick);
+					if (AllocFailed(Nick)) {
+						return false;
+					}
 
-		return true;
-	} else if (argc > 2 && hashRaw == hashJoin) {
-		if (b_Me) {
-			AddChannel(argv[2]);
+					Channel->AddUser(Nick, "");
+					free(Nick);
+				}
 
-			/* GetOwner() can be NULL if AddChannel failed */
-			if (GetOwner() != NULL && Client == NULL) {
-				WriteLine("MODE %s", argv[2]);
+				UpdateHostHelper(Reply);
 			}
-		}
 
-		Channel = GetChannel(argv[2]);
+			break;
 
-		if (Channel != NULL) {
-			Nick = NickFromHostmask(Reply);
+		case IRCCommand_Part:
+			if (argc > 2) {
+				bool bRet = ModuleEvent(argc, argv);
 
-			if (AllocFailed(Nick)) {
-				return false;
+				if (b_Me) {
+					RemoveChannel(argv[2]);
+				} else {
+					Channel = GetChannel(argv[2]);
+
+					if (Channel != NULL) {
+						Nick = ::NickFromHostmask(Reply);
+
+						if (AllocFailed(Nick)) {
+							return false;
+						}
+
+						Channel->RemoveUser(Nick);
+
+						free(Nick);
+					}
+				}
+
+				UpdateHostHelper(Reply);
+
+				return bRet;
 			}
 
-			Channel->AddUser(Nick, "");
-			free(Nick);
-		}
+			break;
 
-		UpdateHostHelper(Reply);
-	} else if (argc > 2 && hashRaw == hashPart) {
-		bool bRet = ModuleEvent(argc, argv);
+		case IRCCommand_Kick:
+			if (argc > 3) {
+				bool bRet = ModuleEvent(argc, argv);
 
-		if (b_Me) {
-			RemoveChannel(argv[2]);
-		} else {
-			Channel = GetChannel(argv[2]);
+				if (m_CurrentNick != NULL && strcasecmp(argv[3], m_CurrentNick) == 0) {
+					RemoveChannel(argv[2]);
 
-			if (Channel != NULL) {
-				Nick = ::NickFromHostmask(Reply);
+					if (Client == NULL) {
+						char *Dup = strdup(Reply);
 
-				if (AllocFailed(Nick)) {
-					return false;
+						if (AllocFailed(Dup)) {
+							return bRet;
+						}
+
+						char *Delim = strchr(Dup, '!');
+						const char *Host = NULL;
+
+						if (Delim) {
+							*Delim = '\0';
+
+							Host = Delim + 1;
+						}
+
+						GetOwner()->Log("%s (%s) kicked you from %s (%s)", Dup, Delim ? Host : "<unknown host>", argv[2], argc > 4 ? argv[4] : "");
+
+						free(Dup);
+					}
+				} else {
+					Channel = GetChannel(argv[2]);
+
+					if (Channel != NULL) {
+						Channel->RemoveUser(argv[3]);
+					}
 				}
 
-				Channel->RemoveUser(Nick);
+				UpdateHostHelper(Reply);
 
-				free(Nick);
+				return bRet;
 			}
-		}
 
-		UpdateHostHelper(Reply);
+			break;
 
-		return bRet;
-	} else if (argc > 3 && hashRaw == hashKick) {
-		bool bRet = ModuleEvent(argc, argv);
+		case 1:
+			if (argc > 2) {
+				if (Client != NULL) {
+					if (strcmp(Client->GetNick(), argv[2]) != 0) {
+						Client->WriteLine(":%s!%s NICK :%s", Client->GetNick(), m_Site ? m_Site : "unknown@unknown.host", argv[2]);
+					}
+				}
 
-		if (m_CurrentNick != NULL && strcasecmp(argv[3], m_CurrentNick) == 0) {
-			RemoveChannel(argv[2]);
+				free(m_CurrentNick);
+				m_CurrentNick = strdup(argv[2]);
 
-			if (Client == NULL) {
-				char *Dup = strdup(Reply);
+				free(m_Server);
+				m_Server = strdup(Reply);
 
-				if (AllocFailed(Dup)) {
-					return bRet;
+				if (Client != NULL) {
+					if (strcmp(m_CurrentNick, Client->GetNick()) != 0) {
+						Client->ChangeNick(m_CurrentNick);
+					}
 				}
 
-				char *Delim = strchr(Dup, '!');
-				const char *Host = NULL;
+				GetOwner()->Log("You were successfully connected to an IRC server.");
+				g_Bouncer->Log("User %s connected to an IRC server.",
+					GetOwner()->GetUsername());
 
-				if (Delim) {
-					*Delim = '\0';
+				int DelayJoin = GetOwner()->GetDelayJoin();
 
-					Host = Delim + 1;
+				if (DelayJoin == 1) {
+					m_DelayJoinTimer = g_Bouncer->CreateTimer(5, false, DelayJoinTimer, this);
+				} else if (DelayJoin == 0) {
+					JoinChannels();
 				}
 
-				GetOwner()->Log("%s (%s) kicked you from %s (%s)", Dup, Delim ? Host : "<unknown host>", argv[2], argc > 4 ? argv[4] : "");
+				if (Client == NULL) {
+					bool AppendTS = (GetOwner()->GetConfig()->ReadInteger("user.ts") != 0);
+					const char *AwayReason = GetOwner()->GetAwayText();
 
-				free(Dup);
-			}
-		} else {
-			Channel = GetChannel(argv[2]);
+					if (AwayReason != NULL) {
+						WriteLine(AppendTS ? "AWAY :%s (Away since the dawn of time)" : "AWAY :%s", AwayReason);
+					}
+				}
 
-			if (Channel != NULL) {
-				Channel->RemoveUser(argv[3]);
-			}
-		}
+				const char *AutoModes = GetOwner()->GetAutoModes();
+				const char *DropModes = GetOwner()->GetDropModes();
 
-		UpdateHostHelper(Reply);
+				if (AutoModes != NULL) {
+					WriteLine("MODE %s +%s", GetCurrentNick(), AutoModes);
+				}
 
-		return bRet;
-	} else if (argc > 2 && iRaw == 1) {
-		if (Client != NULL) {
-			if (strcmp(Client->GetNick(), argv[2]) != 0) {
-				Client->WriteLine(":%s!%s NICK :%s", Client->GetNick(), m_Site ? m_Site : "unknown@unknown.host", argv[2]);
+				if (DropModes != NULL && Client == NULL) {
+					WriteLine("MODE %s -%s", GetCurrentNick(), DropModes);
+				}
+
+				m_State = State_Connected;
 			}
-		}
 
-		free(m_CurrentNick);
-		m_CurrentNick = strdup(argv[2]);
+			break;
 
-		free(m_Server);
-		m_Server = strdup(Reply);
+		case 422:
+		case 376:
+			if (argc > 1) {
+				if (!m_SeenMotd) {
+					m_SeenMotd = true;
+					const CVector<CModule *> *Modules = g_Bouncer->GetModules();
 
-		if (Client != NULL) {
-			if (strcmp(m_CurrentNick, Client->GetNick()) != 0) {
-				Client->ChangeNick(m_CurrentNick);
+					for (int i = 0; i < Modules->GetLength(); i++) {
+						(*Modules)[i]->ServerLogon(GetOwner()->GetUsername());
+					}
+				}
 			}
-		}
 
-		GetOwner()->Log("You were successfully connected to an IRC server.");
-		g_Bouncer->Log("User %s connected to an IRC server.",
-			GetOwner()->GetUsername());
+			break;
 
-		int DelayJoin = GetOwner()->GetDelayJoin();
+		case IRCCommand_Nick:
+			if (argc > 2) {
+				if (b_Me) {
+					free(m_CurrentNick);
+					m_CurrentNick = strdup(argv[2]);
+				}
 
-		if (DelayJoin == 1) {
-			m_DelayJoinTimer = g_Bouncer->CreateTimer(5, false, DelayJoinTimer, this);
-		} else if (DelayJoin == 0) {
-			JoinChannels();
-		}
+				Nick = NickFromHostmask(argv[0]);
 
-		if (Client == NULL) {
-			bool AppendTS = (GetOwner()->GetConfig()->ReadInteger("user.ts") != 0);
-			const char *AwayReason = GetOwner()->GetAwayText();
+				if (!b_Me && GetOwner()->GetClientConnectionMultiplexer() == NULL) {
+					const char *AwayNick = GetOwner()->GetAwayNick();
 
-			if (AwayReason != NULL) {
-				WriteLine(AppendTS ? "AWAY :%s (Away since the dawn of time)" : "AWAY :%s", AwayReason);
+					if (AwayNick != NULL && strcasecmp(AwayNick, Nick) == 0) {
+						WriteLine("NICK %s", AwayNick);
+					}
+				}
+
+				for (CHashtable<CChannel *, false>::Cursor ChannelCursor(m_Channels); ChannelCursor.IsValid(); ChannelCursor.Proceed()) {
+					ChannelCursor->Value->RenameUser(Nick, argv[2]);
+				}
+
+				free(Nick);
 			}
-		}
 
-		const char *AutoModes = GetOwner()->GetAutoModes();
-		const char *DropModes = GetOwner()->GetDropModes();
+			break;
 
-		if (AutoModes != NULL) {
-			WriteLine("MODE %s +%s", GetCurrentNick(), AutoModes);
-		}
+		case IRCCommand_Quit:
+			if (argc > 1) {
+				bool bRet = ModuleEvent(argc, argv);
 
-		if (DropModes != NULL && Client == NULL) {
-			WriteLine("MODE %s -%s", GetCurrentNick(), DropModes);
-		}
+				Nick = NickFromHostmask(argv[0]);
 
-		m_State = State_Connected;
-	} else if (argc > 1 && (iRaw == 422 || iRaw == 376)) {
-		if (!m_SeenMotd) {
-			m_SeenMotd = true;
-			const CVector<CModule *> *Modules = g_Bouncer->GetModules();
+				for (CHashtable<CChannel *, false>::Cursor ChannelCursor(m_Channels); ChannelCursor.IsValid(); ChannelCursor.Proceed()) {
+					ChannelCursor->Value->RemoveUser(Nick);
+				}
+
+				free(Nick);
 
-			for (int i = 0; i < Modules->GetLength(); i++) {
-				(*Modules)[i]->ServerLogon(GetOwner()->GetUsername());
+				return bRet;
 			}
-		}
-	} else if (argc > 2 && hashRaw == hashNick) {
-		if (b_Me) {
-			free(m_CurrentNick);
-			m_CurrentNick = strdup(argv[2]);
-		}
 
-		Nick = NickFromHostmask(argv[0]);
+			break;
+
+		case 465:
+			if (argc > 3) {
+				if (GetCurrentNick() != NULL && GetSite() != NULL) {
+					g_Bouncer->LogUser(GetUser(), "G/K-line reason for user %s [%s!%s]: %s",
+						GetOwner()->GetUsername(), GetCurrentNick(), GetSite(), argv[3]);
+				} else {
+					g_Bouncer->LogUser(GetUser(), "G/K-line reason for user %s: %s",
+						GetOwner()->GetUsername(), argv[3]);
+				}
+			}
 
-		int i = 0;
+			break;
 
-		if (!b_Me && GetOwner()->GetClientConnectionMultiplexer() == NULL) {
-			const char *AwayNick = GetOwner()->GetAwayNick();
+		case 351:
+			if (argc > 5) {
+				free(m_ServerVersion);
+				m_ServerVersion = strdup(argv[3]);
 
-			if (AwayNick != NULL && strcasecmp(AwayNick, Nick) == 0) {
-				WriteLine("NICK %s", AwayNick);
+				free(m_ServerFeat);
+				m_ServerFeat = strdup(argv[5]);
 			}
-		}
 
-		while (hash_t<CChannel *> *ChannelHash = m_Channels->Iterate(i++)) {
-			ChannelHash->Value->RenameUser(Nick, argv[2]);
-		}
+			break;
 
-		free(Nick);
-	} else if (argc > 1 && hashRaw == hashQuit) {
-		bool bRet = ModuleEvent(argc, argv);
+		case 5:
+			if (argc > 3) {
+				for (int i = 3; i < argc - 1; i++) {
+					char *Dup = strdup(argv[i]);
 
-		Nick = NickFromHostmask(argv[0]);
+					if (AllocFailed(Dup)) {
+						return false;
+					}
 
-		int i = 0;
+					char *Eq = strchr(Dup, '=');
 
-		while (hash_t<CChannel *> *ChannelHash = m_Channels->Iterate(i++)) {
-			ChannelHash->Value->RemoveUser(Nick);
-		}
+					if (strcasecmp(Dup, "NAMESX") == 0) {
+						WriteLine("PROTOCTL NAMESX");
+					}
 
-		free(Nick);
+					char *Value;
 
-		return bRet;
-	} else if (argc > 1 && strcasecmp(Reply, "ERROR") == 0) {
-		if (strstr(Raw, "throttle") != NULL) {
-			GetOwner()->ScheduleReconnect(120);
-		} else {
-			GetOwner()->ScheduleReconnect(5);
-		}
+					if (Eq) {
+						*Eq = '\0';
 
-		if (GetCurrentNick() != NULL && GetSite() != NULL) {
-			g_Bouncer->LogUser(GetUser(), "Error received for user %s [%s!%s]: %s",
-				GetOwner()->GetUsername(), GetCurrentNick(), GetSite(), argv[1]);
-		} else {
-			g_Bouncer->LogUser(GetUser(), "Error received for user %s: %s",
-				GetOwner()->GetUsername(), argv[1]);
-		}
-	} else if (argc > 3 && iRaw == 465) {
-		if (GetCurrentNick() != NULL && GetSite() != NULL) {
-			g_Bouncer->LogUser(GetUser(), "G/K-line reason for user %s [%s!%s]: %s",
-				GetOwner()->GetUsername(), GetCurrentNick(), GetSite(), argv[3]);
-		} else {
-			g_Bouncer->LogUser(GetUser(), "G/K-line reason for user %s: %s",
-				GetOwner()->GetUsername(), argv[3]);
-		}
-	} else if (argc > 5 && iRaw == 351) {
-		free(m_ServerVersion);
-		m_ServerVersion = strdup(argv[3]);
+						Value = strdup(++Eq);
+					} else {
+						Value = strdup("");
+					}
 
-		free(m_ServerFeat);
-		m_ServerFeat = strdup(argv[5]);
-	} else if (argc > 3 && iRaw == 5) {
-		for (int i = 3; i < argc - 1; i++) {
-			char *Dup = strdup(argv[i]);
+					m_ISupport->Add(Dup, Value);
 
-			if (AllocFailed(Dup)) {
-				return false;
+					free(Dup);
+				}
+
+				UpdateCaseMapping();
 			}
 
-			char *Eq = strchr(Dup, '=');
+			break;
+
+		case 324:
+			if (argc > 4) {
+				Channel = GetChannel(argv[3]);
 
-			if (strcasecmp(Dup, "NAMESX") == 0) {
-				WriteLine("PROTOCTL NAMESX");
+				if (Channel != NULL) {
+					Channel->ClearModes();
+					Channel->ParseModeChange(argv[0], argv[4], argc - 5, &argv[5]);
+					Channel->SetModesValid(true);
+				}
 			}
 
-			char *Value;
+			break;
 
-			if (Eq) {
-				*Eq = '\0';
+		case IRCCommand_Mode:
+			if (argc > 3) {
+				Channel = GetChannel(argv[2]);
 
-				Value = strdup(++Eq);
-			} else {
-				Value = strdup("");
+				if (Channel != NULL) {
+					Channel->ParseModeChange(argv[0], argv[3], argc - 4, &argv[4]);
+				} else if (m_CurrentNick && strcmp(m_CurrentNick, argv[2]) == 0) {
+					bool Flip = true, WasNull;
+					const char *Modes = argv[3];
+					size_t Length = strlen(Modes) + 1;
+
+					if (m_Usermodes != NULL) {
+						Length += strlen(m_Usermodes);
+					}
+
+					WasNull = (m_Usermodes != NULL) ? false : true;
+					m_Usermodes = (char *)realloc(m_Usermodes, Length);
+
+					if (AllocFailed(m_Usermodes)) {
+						return false;
+					}
+
+					if (WasNull) {
+						m_Usermodes[0] = '\0';
+					}
+
+					while (*Modes != '\0') {
+						if (*Modes == '+') {
+							Flip = true;
+						} else if (*Modes == '-') {
+							Flip = false;
+						} else {
+							if (Flip) {
+								size_t Position = strlen(m_Usermodes);
+								m_Usermodes[Position] = *Modes;
+								m_Usermodes[Position + 1] = '\0';
+							} else {
+								char *CurrentModes = m_Usermodes;
+								size_t a = 0;
+
+								while (*CurrentModes != '\0') {
+									*CurrentModes = m_Usermodes[a];
+
+									if (*CurrentModes != *Modes) {
+										CurrentModes++;
+									}
+
+									a++;
+								}
+							}
+						}
+
+						Modes++;
+					}
+				}
+
+				UpdateHostHelper(Reply);
 			}
 
-			m_ISupport->Add(Dup, Value);
+			break;
 
-			free(Dup);
-		}
-	} else if (argc > 4 && iRaw == 324) {
-		Channel = GetChannel(argv[3]);
+		case 329:
+			if (argc > 4) {
+				Channel = GetChannel(argv[3]);
 
-		if (Channel != NULL) {
-			Channel->ClearModes();
-			Channel->ParseModeChange(argv[0], argv[4], argc - 5, &argv[5]);
-			Channel->SetModesValid(true);
-		}
-	} else if (argc > 3 && hashRaw == hashMode) {
-		Channel = GetChannel(argv[2]);
-
-		if (Channel != NULL) {
-			Channel->ParseModeChange(argv[0], argv[3], argc - 4, &argv[4]);
-		} else if (m_CurrentNick && strcmp(m_CurrentNick, argv[2]) == 0) {
-			bool Flip = true, WasNull;
-			const char *Modes = argv[3];
-			size_t Length = strlen(Modes) + 1;
-
-			if (m_Usermodes != NULL) {
-				Length += strlen(m_Usermodes);
+				if (Channel != NULL) {
+					Channel->SetCreationTime(atoi(argv[4]));
+				}
 			}
 
-			WasNull = (m_Usermodes != NULL) ? false : true;
-			m_Usermodes = (char *)realloc(m_Usermodes, Length);
+			break;
 
-			if (AllocFailed(m_Usermodes)) {
-				return false;
+		case 332:
+			if (argc > 4) {
+				Channel = GetChannel(argv[3]);
+
+				if (Channel != NULL) {
+					Channel->SetTopic(argv[4]);
+				}
 			}
 
-			if (WasNull) {
-				m_Usermodes[0] = '\0';
+			break;
+
+		case 333:
+			if (argc > 5) {
+				Channel = GetChannel(argv[3]);
+
+				if (Channel != NULL) {
+					Channel->SetTopicNick(argv[4]);
+					Channel->SetTopicStamp(atoi(argv[5]));
+				}
 			}
 
-			while (*Modes != '\0') {
-				if (*Modes == '+') {
-					Flip = true;
-				} else if (*Modes == '-') {
-					Flip = false;
-				} else {
-					if (Flip) {
-						size_t Position = strlen(m_Usermodes);
-						m_Usermodes[Position] = *Modes;
-						m_Usermodes[Position + 1] = '\0';
-					} else {
-						char *CurrentModes = m_Usermodes;
-						size_t a = 0;
+			break;
 
-						while (*CurrentModes != '\0') {
-							*CurrentModes = m_Usermodes[a];
+		case 331:
+			if (argc > 3) {
+				Channel = GetChannel(argv[3]);
 
-							if (*CurrentModes != *Modes) {
-								CurrentModes++;
-							}
+				if (Channel != NULL) {
+					Channel->SetNoTopic();
+				}
+			}
 
-							a++;
-						}
-					}
+			break;
+
+		case IRCCommand_Topic:
+			if (argc > 3) {
+				Channel = GetChannel(argv[2]);
+
+				if (Channel != NULL) {
+					Channel->SetTopic(argv[3]);
+					Channel->SetTopicStamp(g_CurrentTime);
+					Channel->SetTopicNick(argv[0]);
 				}
 
-				Modes++;
+				UpdateHostHelper(Reply);
 			}
-		}
 
-		UpdateHostHelper(Reply);
-	} else if (argc > 4 && iRaw == 329) {
-		Channel = GetChannel(argv[3]);
+			break;
 
-		if (Channel != NULL) {
-			Channel->SetCreationTime(atoi(argv[4]));
-		}
-	} else if (argc > 4 && iRaw == 332) {
-		Channel = GetChannel(argv[3]);
+		case 353:
+			if (argc > 5) {
+				Channel = GetChannel(argv[4]);
 
-		if (Channel != NULL) {
-			Channel->SetTopic(argv[4]);
-		}
-	} else if (argc > 5 && iRaw == 333) {
-		Channel = GetChannel(argv[3]);
+				if (Channel != NULL) {
+					const char *nicks;
+					const char **nickv;
 
-		if (Channel != NULL) {
-			Channel->SetTopicNick(argv[4]);
-			Channel->SetTopicStamp(atoi(argv[5]));
-		}
-	} else if (argc > 3 && iRaw == 331) {
-		Channel = GetChannel(argv[3]);
+					nicks = ArgTokenize(argv[5]);
 
-		if (Channel != NULL) {
-			Channel->SetNoTopic();
-		}
-	} else if (argc > 3 && hashRaw == hashTopic) {
-		Channel = GetChannel(argv[2]);
+					if (AllocFailed(nicks)) {
+						return false;
+					}
 
-		if (Channel != NULL) {
-			Channel->SetTopic(argv[3]);
-			Channel->SetTopicStamp(g_CurrentTime);
-			Channel->SetTopicNick(argv[0]);
-		}
+					nickv = ArgToArray(nicks);
 
-		UpdateHostHelper(Reply);
-	} else if (argc > 5 && iRaw == 353) {
-		Channel = GetChannel(argv[4]);
+					if (AllocFailed(nickv)) {
+						ArgFree(nicks);
 
-		if (Channel != NULL) {
-			const char *nicks;
-			const char **nickv;
+						return false;
+					}
 
-			nicks = ArgTokenize(argv[5]);
+					int nickc = ArgCount(nicks);
 
-			if (AllocFailed(nicks)) {
-				return false;
-			}
+					for (int i = 0; i < nickc; i++) {
+						char *Nick = strdup(nickv[i]);
+						char *BaseNick = Nick;
 
-			nickv = ArgToArray(nicks);
+						if (AllocFailed(Nick)) {
+							ArgFreeArray(nickv);
+							ArgFree(nicks);
 
-			if (AllocFailed(nickv)) {
-				ArgFree(nicks);
+							return false;
+						}
 
-				return false;
-			}
+						StrTrim(Nick, ' ');
+
+						while (IsNickPrefix(*Nick)) {
+							Nick++;
+						}
 
-			int nickc = ArgCount(nicks);
+						char *Modes = NULL;
+
+						if (BaseNick != Nick) {
+							Modes = (char *)malloc(Nick - BaseNick + 1);
+
+							if (!AllocFailed(Modes)) {
+								strmcpy(Modes, BaseNick, Nick - BaseNick + 1);
+							}
+						}
 
-			for (int i = 0; i < nickc; i++) {
-				char *Nick = strdup(nickv[i]);
-				char *BaseNick = Nick;
+						Channel->AddUser(Nick, Modes);
+
+						free(BaseNick);
+						free(Modes);
+					}
 
-				if (AllocFailed(Nick)) {
 					ArgFreeArray(nickv);
 					ArgFree(nicks);
+				}
+			}
 
-					return false;
+			break;
+
+		case 366:
+			if (argc > 3) {
+				Channel = GetChannel(argv[3]);
+
+				if (Channel != NULL) {
+					Channel->SetHasNames();
 				}
+			}
+
+			break;
 
-				StrTrim(Nick, ' ');
+		case 352:
+			if (argc > 9) {
+				const char *Ident = argv[4];
+				const char *Host = argv[5];
+				const char *Server = argv[6];
+				const char *Nick = argv[7];
+				const char *Realname = argv[9];
+				char *Mask;
 
-				while (IsNickPrefix(*Nick)) {
-					Nick++;
+				int rc = asprintf(&Mask, "%s!%s@%s", Nick, Ident, Host);
+
+				if (!RcFailed(rc)) {
+					UpdateHostHelper(Mask);
+					UpdateWhoHelper(Nick, Realname, Server);
+
+					free(Mask);
 				}
+			}
 
-				char *Modes = NULL;
+			break;
 
-				if (BaseNick != Nick) {
-					Modes = (char *)malloc(Nick - BaseNick + 1);
+		case 367:
+			if (argc > 6) {
+				Channel = GetChannel(argv[3]);
 
-					if (!AllocFailed(Modes)) {
-						strmcpy(Modes, BaseNick, Nick - BaseNick + 1);
-					}
+				if (Channel != NULL) {
+					Channel->GetBanlist()->SetBan(argv[4], argv[5], atoi(argv[6]));
 				}
+			}
+
+			break;
 
-				Channel->AddUser(Nick, Modes);
+		case 368:
+			if (argc > 3) {
+				Channel = GetChannel(argv[3]);
 
-				free(BaseNick);
-				free(Modes);
+				if (Channel != NULL) {
+					Channel->SetHasBans();
+				}
 			}
 
-			ArgFreeArray(nickv);
-			ArgFree(nicks);
-		}
-	} else if (argc > 3 && iRaw == 366) {
-		Channel = GetChannel(argv[3]);
+			break;
 
-		if (Channel != NULL) {
-			Channel->SetHasNames();
-		}
-	} else if (argc > 9 && iRaw == 352) {
-		const char *Ident = argv[4];
-		const char *Host = argv[5];
-		const char *Server = argv[6];
-		const char *Nick = argv[7];
-		const char *Realname = argv[9];
-		char *Mask;
+		case 396:
+			if (argc > 3) {
+				free(m_Site);
+				m_Site = strdup(argv[3]);
 
-		int rc = asprintf(&Mask, "%s!%s@%s", Nick, Ident, Host);
+				if (AllocFailed(m_Site)) {}
+			}
 
-		if (!RcFailed(rc)) {
-			UpdateHostHelper(Mask);
-			UpdateWhoHelper(Nick, Realname, Server);
+			break;
 
-			free(Mask);
-		}
-	} else if (argc > 6 && iRaw == 367) {
-		Channel = GetChannel(argv[3]);
+		case IRCCommand_Pong:
+			if (argc > 3 && m_Server != NULL && strcasecmp(argv[2], m_Server) == 0 && m_EatPong) {
+				m_EatPong = false;
 
-		if (Channel != NULL) {
-			Channel->GetBanlist()->SetBan(argv[4], argv[5], atoi(argv[6]));
-		}
-	} else if (argc > 3 && iRaw == 368) {
-		Channel = GetChannel(argv[3]);
+				return false;
+			}
 
-		if (Channel != NULL) {
-			Channel->SetHasBans();
-		}
-	} else if (argc > 3 && iRaw == 396) {
-		free(m_Site);
-		m_Site = strdup(argv[3]);
+			break;
 
-		if (AllocFailed(m_Site)) {}
-	} else if (argc > 3 && hashRaw == hashPong && m_Server != NULL && strcasecmp(argv[2], m_Server) == 0 && m_EatPong) {
-		m_EatPong = false;
+		case IRCCommand_Cap:
+			if (argc > 4) {
+				// message-tags is the only capability we request
+				if (strcasecmp(argv[3], "ACK") == 0) {
+					m_MessageTags = true;
+				}
 
-		return false;
-	} else if (argc > 3 && iRaw == 421) {
-		m_FloodControl->Unplug();
+				if (m_State != State_Connected && (strcasecmp(argv[3], "ACK") == 0 ||
+						strcasecmp(argv[3], "NAK") == 0)) {
+					WriteLine("CAP END");
+				}
 
-		return false;
+				return false;
+			}
+
+			break;
+
+		case IRCCommand_Tagmsg:
+			// a TAGMSG without any tags doesn't carry any information
+			if (m_CurrentTags == NULL) {
+				return false;
+			}
+
+			break;
+
+		case 421:
+			// servers which don't support CAP reply to our CAP REQ with a 421
+			if (argc > 3 && strcasecmp(argv[3], "CAP") == 0) {
+				return false;
+			}
+
+			break;
+
+		default:
+			if (argc > 1 && strcasecmp(Reply, "ERROR") == 0) {
+				if (strstr(Raw, "throttle") != NULL) {
+					GetOwner()->ScheduleReconnect(120);
+				} else {
+					GetOwner()->ScheduleReconnect(5);
+				}
+
+				if (GetCurrentNick() != NULL && GetSite() != NULL) {
+					g_Bouncer->LogUser(GetUser(), "Error received for user %s [%s!%s]: %s",
+						GetOwner()->GetUsername(), GetCurrentNick(), GetSite(), argv[1]);
+				} else {
+					g_Bouncer->LogUser(GetUser(), "Error received for user %s: %s",
+						GetOwner()->GetUsername(), argv[1]);
+				}
+			}
+
+			break;
 	}
 
 	if (GetOwner() != NULL) {
@@ -803,30 +977,29 @@ bool CIRCConnection::ModuleEvent(int argc, const char **argv) {
  * @param Line the line
  */
 void CIRCConnection::ParseLine(const char *Line) {
-	const char *RealLine = Line;
+	ircmessage_t Message;
 	char *Out;
 
 	if (GetOwner() == NULL) {
 		return;
 	}
 
-	if (Line[0] == ':') {
-		RealLine = Line + 1;
-	} else {
-		RealLine = Line;
-	}
-
-	tokendata_t Args = ArgTokenize2(RealLine);
-	const char **argv = ArgToArray2(Args);
-	int argc = ArgCount2(Args);
+	ArgTokenizeMessage(Line, &Message);
 
-	if (argv == NULL) {
-		g_Bouncer->Log("ArgToArray2 returned NULL. Could not parse line (%s).", Line);
+	const char **argv = Message.ArgV;
+	int argc = Message.ArgC;
 
+	if (argc == 0) {
 		return;
 	}
 
-	if (ParseLineArgV(argc, argv)) {
+	m_CurrentTags = Message.Tags;
+
+	bool ReturnValue = ParseLineArgV(argc, argv);
+
+	m_CurrentTags = NULL;
+
+	if (ReturnValue) {
 		if (strcasecmp(argv[0], "ping") == 0 && argc > 1) {
 			int rc = asprintf(&Out, "PONG :%s", argv[1]);
 
@@ -865,8 +1038,6 @@ void CIRCConnection::ParseLine(const char *Line) {
 #endif
 
 	//puts(Line);
-
-	ArgFreeArray(argv);
 }
 
 /**
@@ -1022,6 +1193,39 @@ const char *CIRCConnection::GetISupport(const char *Feature) const {
  */
 void CIRCConnection::SetISupport(const char *Feature, const char *Value) {
 	m_ISupport->Add(Feature, strdup(Value));
+
+	if (strcasecmp(Feature, "CASEMAPPING") == 0) {
+		UpdateCaseMapping();
+	}
+}
+
+/**
+ * GetCaseMapping
+ *
+ * Returns the case-folding table for the server's casemapping.
+ */
+const unsigned char *CIRCConnection::GetCaseMapping(void) const {
+	return m_Channels->GetCaseMapping();
+}
+
+/**
+ * UpdateCaseMapping
+ *
+ * Applies the server's casemapping (from the CASEMAPPING feature) to
+ * the channel and nick hashtables.
+ */
+void CIRCConnection::UpdateCaseMapping(void) {
+	const unsigned char *CaseMapping = ::GetCaseMapping(GetISupport("CASEMAPPING"));
+
+	if (CaseMapping == m_Channels->GetCaseMapping()) {
+		return;
+	}
+
+	m_Channels->SetCaseMapping(CaseMapping);
+
+	for (CHashtable<CChannel *, false>::Cursor ChannelCursor(m_Channels); ChannelCursor.IsValid(); ChannelCursor.Proceed()) {
+		ChannelCursor->Value->SetCaseMapping(CaseMapping);
+	}
 }
 
 /**
@@ -1304,7 +1508,12 @@ CFloodControl *CIRCConnection::GetFloodControl(void) {
  * @param In the line
  */
 void CIRCConnection::WriteUnformattedLine(const char *In) {
-	if (strlen(In) < 512) {
+	// tags are only sent to servers which support them
+	if (!m_MessageTags) {
+		In = ArgStripTags(In);
+	}
+
+	if (strlen(ArgStripTags(In)) < 512 && strlen(In) < IRCMESSAGE_MAXLENGTH) {
 		m_QueueMiddle->QueueItem(In);
 	}
 }
@@ -1558,7 +1767,7 @@ void CIRCConnection::AsyncBindIpDnsFinished(hostent *Response) {
 	if ((Response == NULL || Response->h_addr_list[0] == NULL) && GetOwner() != NULL) {
 		g_Bouncer->LogUser(GetOwner(), "DNS request (vhost) for user %s failed. Cancelling connection attempt.", GetOwner()->GetUsername());
 
-		m_LatchedDestruction = true;
+		LatchDestruction();
 
 		return;
 	}
@@ -1737,3 +1946,26 @@ bool NickCatchTimer(time_t Now, void *IRCConnection) {
 int CIRCConnection::GetState(void) {
 	return m_State;
 }
+
+/**
+ * HasMessageTags
+ *
+ * Returns whether the server has acknowledged the message-tags capability.
+ */
+bool CIRCConnection::HasMessageTags(void) const {
+	return m_MessageTags;
+}
+
+/**
+ * GetMessageTag
+ *
+ * Looks up a tag of the line which is currently being processed and decodes
+ * its value. Returns false if the line does not have the specified tag.
+ *
+ * @param Name the tag's name
+ * @param Value a buffer for the tag's value (may be NULL)
+ * @param Size the size of the buffer
+ */
+bool CIRCConnection::GetMessageTag(const char *Name, char *Value, size_t Size) const {
+	return ArgGetTag(m_CurrentTags, Name, Value, Size);
+}
@@ -91,10 +91,14 @@ private:
 
 	bool m_EatPong; /**< whether to ignore the next PONG event from the IRC server */
 
+	bool m_MessageTags; /**< whether the server has acknowledged the message-tags capability */
+	const char *m_CurrentTags; /**< the tags of the line which is currently being parsed */
+
 	CChannel *AddChannel(const char *Channel);
 	void RemoveChannel(const char *Channel);
 
 	void UpdateChannelConfig(void);
+	void UpdateCaseMapping(void);
 	void UpdateHostHelper(const char *Host);
 	void UpdateWhoHelper(const char *Nick, const char *Realname, const char *Server);
 
@@ -139,6 +143,7 @@ public:
 	const CHashtable<char *, false> *GetISupportAll(void) const;
 	const char *GetISupport(const char *Feature) const;
 	void SetISupport(const char *Feature, const char *Value);
+	const unsigned char *GetCaseMapping(void) const;
 	bool IsChanMode(char Mode) const;
 	int RequiresParameter(char Mode) const;
 	bool IsNickPrefix(char Char) const;
@@ -159,6 +164,9 @@ public:
 	const char *GetUsermodes(void);
 
 	int GetState(void);
+
+	bool HasMessageTags(void) const;
+	bool GetMessageTag(const char *Name, char *Value, size_t Size) const;
 };
 
 #endif /* IRCCONNECTION_H */
@@ -20,6 +20,13 @@
 #ifndef LISTENER_H
 #define LISTENER_H
 
+#define LISTENER_ACCEPTBATCH 64 /**< the maximum number of connections which
+									are accepted per event */
+#define LISTENER_MAXSOCKETS 64 /**< the maximum number of SO_REUSEPORT sockets
+									per client listener */
+#define LISTENER_ACCEPTWINDOW 60 /**< the interval (in seconds) for the
+									listener's accept rate */
+
 /**
  * CListenerBase<InheritedClass>
  *
@@ -29,16 +36,55 @@ template<typename InheritedClass>
 class CListenerBase : public CSocketEvents {
 private:
 	SOCKET m_Listener; /**< the listening socket */
+	unsigned int m_AcceptCount; /**< the number of accepted connections */
+	unsigned int m_RecentAccepts; /**< the number of connections accepted
+									since m_AcceptReset */
+	time_t m_AcceptReset; /**< when m_RecentAccepts was last reset */
 
 	virtual int Read(bool DontProcess) {
-		sockaddr_storage PeerAddress;
-		socklen_t PeerSize = sizeof(PeerAddress);
-		SOCKET Client;
+		CSocketEvents *Events = static_cast<CSocketEvents *>(this);
+		time_t Now = time(NULL);
+
+		if (Now - m_AcceptReset >= LISTENER_ACCEPTWINDOW) {
+			m_AcceptReset = Now;
+			m_RecentAccepts = 0;
+		}
+
+		// accept pending connections until the backlog is empty
+		for (int i = 0; i < LISTENER_ACCEPTBATCH; i++) {
+			sockaddr_storage PeerAddress;
+			socklen_t PeerSize = sizeof(PeerAddress);
+			SOCKET Client;
+
+#ifdef HAVE_ACCEPT4
+			Client = accept4(m_Listener, (sockaddr *)&PeerAddress, &PeerSize, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else /* HAVE_ACCEPT4 */
+			Client = accept(m_Listener, (sockaddr *)&PeerAddress, &PeerSize);
+#endif /* HAVE_ACCEPT4 */
+
+			if (Client == INVALID_SOCKET) {
+				break;
+			}
+
+#ifndef HAVE_ACCEPT4
+			unsigned long lTrue = 1;
+
+			ioctlsocket(Client, FIONBIO, &lTrue);
 
-		Client = accept(m_Listener, (sockaddr *)&PeerAddress, &PeerSize);
+#	ifndef _WIN32
+			fcntl(Client, F_SETFD, FD_CLOEXEC);
+#	endif /* _WIN32 */
+#endif /* HAVE_ACCEPT4 */
+
+			m_AcceptCount++;
+			m_RecentAccepts++;
 
-		if (Client != INVALID_SOCKET) {
 			Accept(Client, (sockaddr *)&PeerAddress);
+
+			// Accept() might have destroyed the listener
+			if (!g_Bouncer->IsRegisteredSocket(Events)) {
+				break;
+			}
 		}
 
 		return 0;
@@ -63,12 +109,16 @@ public:
 	 * @param Port the port of the socket listener
 	 * @param BindIp the ip address used for binding the listener
 	 * @param Family the socket family of the listener (AF_INET or AF_INET6)
+	 * @param ReusePort whether other listeners may share the port
 	 */
-	CListenerBase(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET) {
+	CListenerBase(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET, bool ReusePort = false) {
 		m_Listener = INVALID_SOCKET;
+		m_AcceptCount = 0;
+		m_RecentAccepts = 0;
+		m_AcceptReset = time(NULL);
 
 		if (m_Listener == INVALID_SOCKET) {
-			m_Listener = g_Bouncer->CreateListener(Port, BindIp, Family);
+			m_Listener = g_Bouncer->CreateListener(Port, BindIp, Family, ReusePort);
 		}
 
 		if (m_Listener != INVALID_SOCKET) {
@@ -138,6 +188,30 @@ public:
 			}
 		}
 	}
+
+	/**
+	 * GetAcceptCount
+	 *
+	 * Returns the number of connections which have been accepted by
+	 * the listener.
+	 */
+	unsigned int GetAcceptCount(void) const {
+		return m_AcceptCount;
+	}
+
+	/**
+	 * GetRecentAccepts
+	 *
+	 * Returns the number of connections which have been accepted during
+	 * the current accept rate interval (LISTENER_ACCEPTWINDOW seconds).
+	 */
+	unsigned int GetRecentAccepts(void) const {
+		if (time(NULL) - m_AcceptReset >= LISTENER_ACCEPTWINDOW) {
+			return 0;
+		}
+
+		return m_RecentAccepts;
+	}
 };
 
 /**
@@ -155,20 +229,60 @@ public:
   */
 IMPL_SOCKETLISTENER(CClientListener) {
 	bool m_SSL; /**< whether this is an SSL listener */
+	CVector<CClientListener *> m_Siblings; /**< additional listeners which share
+											the port using SO_REUSEPORT */
 public:
 	/**
 	 * CClientListener
 	 *
-	 * Constructs  a new client listener.
+	 * Constructs  a new client listener. If more than one socket is requested
+	 * the listener creates additional listeners for the same port and the
+	 * kernel distributes new connections among them.
 	 *
 	 * @param Port the port
 	 * @param BindIp the bind address (or NULL)
 	 * @param Family socket family (AF_INET or AF_INET6)
 	 * @param SSL whether the listener should be using ssl
+	 * @param Sockets the number of sockets for this port
+	 * @param ReusePort whether to use SO_REUSEPORT even for a single socket
 	 */
 	CClientListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET,
-			bool SSL = false) : CListenerBase<CClientListener>(Port, BindIp, Family) {
+			bool SSL = false, int Sockets = 1, bool ReusePort = false)
+			: CListenerBase<CClientListener>(Port, BindIp, Family, ReusePort || Sockets > 1) {
 		m_SSL = SSL;
+
+		if (!IsValid()) {
+			return;
+		}
+
+		for (int i = 1; i < Sockets; i++) {
+			CClientListener *Sibling = new CClientListener(Port, BindIp, Family, SSL, 1, true);
+
+			if (Sibling == NULL || !Sibling->IsValid()) {
+				delete Sibling;
+
+				break;
+			}
+
+			RESULT<bool> Result = m_Siblings.Insert(Sibling);
+
+			if (IsError(Result)) {
+				delete Sibling;
+
+				break;
+			}
+		}
+	}
+
+	/**
+	 * ~CClientListener
+	 *
+	 * Destructs a client listener and its sibling listeners.
+	 */
+	virtual ~CClientListener(void) {
+		for (int i = 0; i < m_Siblings.GetLength(); i++) {
+			delete m_Siblings[i];
+		}
 	}
 
 	/**
@@ -180,10 +294,6 @@ public:
 	 * @param PeerAddress the remote address of the client
 	 */
 	virtual void Accept(SOCKET Client, const sockaddr *PeerAddress) {
-		unsigned long lTrue = 1;
-
-		ioctlsocket(Client, FIONBIO, &lTrue);
-
 		// destruction is controlled by the main loop
 		new CClientConnection(Client, m_SSL);
 	}
@@ -197,6 +307,10 @@ public:
 	 */
 	void SetSSL(bool SSL) {
 		m_SSL = SSL;
+
+		for (int i = 0; i < m_Siblings.GetLength(); i++) {
+			m_Siblings[i]->SetSSL(SSL);
+		}
 	}
 
 	/**
@@ -207,6 +321,47 @@ public:
 	bool GetSSL(void) const {
 		return m_SSL;
 	}
+
+	/**
+	 * GetSocketCount
+	 *
+	 * Returns the number of sockets which are used by this listener.
+	 */
+	int GetSocketCount(void) const {
+		return 1 + m_Siblings.GetLength();
+	}
+
+	/**
+	 * GetAcceptCount
+	 *
+	 * Returns the number of connections which have been accepted by
+	 * the listener and its siblings.
+	 */
+	unsigned int GetAcceptCount(void) const {
+		unsigned int Count = CListenerBase<CClientListener>::GetAcceptCount();
+
+		for (int i = 0; i < m_Siblings.GetLength(); i++) {
+			Count += m_Siblings[i]->GetAcceptCount();
+		}
+
+		return Count;
+	}
+
+	/**
+	 * GetRecentAccepts
+	 *
+	 * Returns the number of connections which have recently been accepted
+	 * by the listener and its siblings.
+	 */
+	unsigned int GetRecentAccepts(void) const {
+		unsigned int Count = CListenerBase<CClientListener>::GetRecentAccepts();
+
+		for (int i = 0; i < m_Siblings.GetLength(); i++) {
+			Count += m_Siblings[i]->GetRecentAccepts();
+		}
+
+		return Count;
+	}
 };
 #else /* SBNC */
 class CClientListener;
@@ -20,88 +20,177 @@
 #include "StdAfx.h"
 
 /**
- * PeekItems
+ * CQueue
  *
- * Retrieves the next item from the queue without removing it.
+ * Constructs an empty queue.
  */
-RESULT<const char *> CQueue::PeekItem(void) const {
-	int LowestPriority = 99999;
-	queue_item_t *ThatItem = NULL;
+CQueue::CQueue(void) {
+	m_Items = NULL;
+	m_Capacity = 0;
+	m_Head = 0;
+	m_Count = 0;
+	m_NotifyProc = NULL;
+	m_NotifyCookie = NULL;
+}
 
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		if (m_Items[i].Priority < LowestPriority) {
-			LowestPriority = m_Items[i].Priority;
-			ThatItem = m_Items.GetAddressOf(i);
-		}
+/**
+ * ~CQueue
+ *
+ * Destructs a queue.
+ */
+CQueue::~CQueue(void) {
+	for (int i = 0; i < m_Count; i++) {
+		free(m_Items[(m_Head + i) % m_Capacity]);
 	}
 
-	if (ThatItem != NULL) {
-		RETURN(const char *, ThatItem->Line);
-	} else {
+	free(m_Items);
+}
+
+/**
+ * Grow
+ *
+ * Doubles the size of the ring buffer (up to MAX_QUEUE_SIZE slots). Returns
+ * false if the ring buffer could not be resized.
+ */
+bool CQueue::Grow(void) {
+	int Capacity = (m_Capacity == 0) ? QUEUE_INITIAL_CAPACITY : m_Capacity * 2;
+	char **Items;
+
+	if (Capacity > MAX_QUEUE_SIZE) {
+		Capacity = MAX_QUEUE_SIZE;
+	}
+
+	Items = (char **)malloc(Capacity * sizeof(char *));
+
+	if (AllocFailed(Items)) {
+		return false;
+	}
+
+	// the items are moved to the start of the new buffer
+	for (int i = 0; i < m_Count; i++) {
+		Items[i] = m_Items[(m_Head + i) % m_Capacity];
+	}
+
+	free(m_Items);
+
+	m_Items = Items;
+	m_Capacity = Capacity;
+	m_Head = 0;
+
+	return true;
+}
+
+/**
+ * PeekItems
+ *
+ * Retrieves an item (by default the next one) from the queue without
+ * removing it.
+ *
+ * @param Index the item's position in the queue
+ */
+RESULT<const char *> CQueue::PeekItem(int Index) const {
+	if (m_Count == 0) {
 		THROW(const char *, Generic_Unknown, "The queue is empty.");
 	}
+
+	if (Index < 0 || Index >= m_Count) {
+		THROW(const char *, Generic_InvalidArgument, "Index out of range.");
+	}
+
+	RETURN(const char *, m_Items[(m_Head + Index) % m_Capacity]);
 }
 
 /**
  * DequeueItem
  *
- * Retrieves the next item from the queue and removes it.
+ * Retrieves an item (by default the next one) from the queue and removes
+ * it. Removing any other than the first item takes O(Index) time.
+ *
+ * @param Index the item's position in the queue
  */
-RESULT<char *> CQueue::DequeueItem(void) {
-	int Index = 0;
-	queue_item_t *Item = NULL;
+RESULT<char *> CQueue::DequeueItem(int Index) {
 	char *Line;
 
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		if (Item == NULL || m_Items[i].Priority < Item->Priority) {
-			Item = m_Items.GetAddressOf(i);
-			Index = i;
-		}
+	if (m_Count == 0) {
+		THROW(char *, Generic_Unknown, "The queue is empty.");
 	}
 
-	if (Item != NULL) {
-		Line = Item->Line;
+	if (Index < 0 || Index >= m_Count) {
+		THROW(char *, Generic_InvalidArgument, "Index out of range.");
+	}
 
-		m_Items.Remove(Index);
+	Line = m_Items[(m_Head + Index) % m_Capacity];
 
-		RETURN(char *, Line);
-	} else {
-		THROW(char *, Generic_Unknown, "The queue is empty.");
+	// the items in front of the removed item move back by one slot
+	for (int i = Index; i > 0; i--) {
+		m_Items[(m_Head + i) % m_Capacity] = m_Items[(m_Head + i - 1) % m_Capacity];
 	}
+
+	m_Head = (m_Head + 1) % m_Capacity;
+	m_Count--;
+
+	if (m_Count == 0 && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
+
+	RETURN(char *, Line);
 }
 
 /**
- * QueueItem
+ * Insert
  *
- * Inserts a new item at the end of the queue.
+ * Inserts a new item at the front or at the end of the queue.
  *
  * @param Line the item which is to be inserted
+ * @param Front whether to insert the item at the front of the queue
  */
-RESULT<bool> CQueue::QueueItem(const char *Line) {
-	queue_item_t Item;
+RESULT<bool> CQueue::Insert(const char *Line, bool Front) {
+	char *Copy;
 
 	if (Line == NULL) {
 		THROW(bool, Generic_InvalidArgument, "Line cannot be NULL.");
 	}
 
 	// ignore new items if the queue is full
-	if (m_Items.GetLength() >= MAX_QUEUE_SIZE) {
+	if (m_Count >= MAX_QUEUE_SIZE) {
 		THROW(bool, Generic_Unknown, "The queue is full.");
 	}
 
-	Item.Line = strdup(Line);
+	if (m_Count == m_Capacity && !Grow()) {
+		THROW(bool, Generic_OutOfMemory, "malloc() failed.");
+	}
 
-	if (AllocFailed(Item.Line)) {
+	Copy = strdup(Line);
+
+	if (AllocFailed(Copy)) {
 		THROW(bool, Generic_OutOfMemory, "strdup() failed.");
 	}
 
-	Item.Priority = 0;
+	if (Front) {
+		m_Head = (m_Head + m_Capacity - 1) % m_Capacity;
+		m_Items[m_Head] = Copy;
+	} else {
+		m_Items[(m_Head + m_Count) % m_Capacity] = Copy;
+	}
+
+	m_Count++;
 
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		m_Items[i].Priority--;
+	if (m_Count == 1 && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
 	}
 
-	return m_Items.Insert(Item);
+	RETURN(bool, true);
+}
+
+/**
+ * QueueItem
+ *
+ * Inserts a new item at the end of the queue.
+ *
+ * @param Line the item which is to be inserted
+ */
+RESULT<bool> CQueue::QueueItem(const char *Line) {
+	return Insert(Line, false);
 }
 
 /**
@@ -112,11 +201,7 @@ RESULT<bool> CQueue::QueueItem(const char *Line) {
  * @param Line the item which is to be inserted
  */
 RESULT<bool> CQueue::QueueItemNext(const char *Line) {
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		m_Items[i].Priority += 2;
-	}
-
-	return QueueItem(Line);
+	return Insert(Line, true);
 }
 
 /**
@@ -125,7 +210,7 @@ RESULT<bool> CQueue::QueueItemNext(const char *Line) {
  * Returns the number of items which are in the queue.
  */
 int CQueue::GetLength(void) const {
-	return m_Items.GetLength();
+	return m_Count;
 }
 
 /**
@@ -134,9 +219,30 @@ int CQueue::GetLength(void) const {
  * Removes all items from the queue.
  */
 void CQueue::Clear(void) {
-	for (int i = 0; i < m_Items.GetLength(); i++) {
-		free(m_Items[i].Line);
+	bool WasEmpty = (m_Count == 0);
+
+	for (int i = 0; i < m_Count; i++) {
+		free(m_Items[(m_Head + i) % m_Capacity]);
 	}
 
-	m_Items.Clear();
+	m_Head = 0;
+	m_Count = 0;
+
+	if (!WasEmpty && m_NotifyProc != NULL) {
+		m_NotifyProc(m_NotifyCookie);
+	}
+}
+
+/**
+ * SetNotifyProc
+ *
+ * Sets a function which is called whenever the queue becomes empty or
+ * non-empty.
+ *
+ * @param NotifyProc the function (or NULL)
+ * @param Cookie a cookie which is passed to the function
+ */
+void CQueue::SetNotifyProc(void (*NotifyProc)(void *Cookie), void *Cookie) {
+	m_NotifyProc = NotifyProc;
+	m_NotifyCookie = Cookie;
 }
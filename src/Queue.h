@@ -23,30 +23,43 @@
 /** Defines how many items can be stored in a single queue */
 #define MAX_QUEUE_SIZE 500
 
-/**
- * queue_item_t
- *
- * An item from a queue.
- */
-typedef struct queue_item_s {
-	int Priority; /**< the priority of this item; 0 is the highest priority */
-	char *Line; /**< the string which is associated with this item */
-} queue_item_t;
+/** The initial number of slots in a queue's ring buffer */
+#define QUEUE_INITIAL_CAPACITY 16
 
 /**
  * CQueue
  *
- * A queue which can be used for storing strings.
+ * A queue which can be used for storing strings. The items are stored in
+ * a ring buffer, so items can be added at either end and removed from the
+ * front in constant time.
  */
 class SBNCAPI CQueue {
-	CVector<queue_item_t> m_Items; /**< the items which are in the queue */
+	char **m_Items; /**< the ring buffer */
+	int m_Capacity; /**< the number of slots in the ring buffer */
+	int m_Head; /**< the slot of the first item */
+	int m_Count; /**< the number of items which are in the queue */
+	void (*m_NotifyProc)(void *Cookie); /**< called when the queue becomes
+									empty or non-empty */
+	void *m_NotifyCookie; /**< cookie for the notify function */
+
+	bool Grow(void);
+	RESULT<bool> Insert(const char *Line, bool Front);
 public:
-	RESULT<char *> DequeueItem(void);
-	RESULT<const char *> PeekItem(void) const;
+#ifndef SWIG
+	CQueue(void);
+	virtual ~CQueue(void);
+#endif /* SWIG */
+
+	RESULT<char *> DequeueItem(int Index = 0);
+	RESULT<const char *> PeekItem(int Index = 0) const;
 	RESULT<bool> QueueItem(const char *Line);
 	RESULT<bool> QueueItemNext(const char *Line);
 	int GetLength(void) const;
 	void Clear(void);
+
+#ifndef SWIG
+	void SetNotifyProc(void (*NotifyProc)(void *Cookie), void *Cookie);
+#endif /* SWIG */
 };
 
 #endif /* QUEUE_H */
@@ -0,0 +1,445 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+#ifdef HAVE_LIBSSL
+
+/**
+ * TicketKeysRotateTimer
+ *
+ * Replaces the current ticket key when it has expired.
+ *
+ * @param Now the current time
+ * @param Keys the CSSLTicketKeys object
+ */
+bool TicketKeysRotateTimer(time_t Now, void *Keys) {
+	CSSLTicketKeys *TicketKeys = (CSSLTicketKeys *)Keys;
+
+	if (TicketKeys->m_KeyCount == 0 ||
+			TicketKeys->m_Keys[0].Created + (time_t)TicketKeys->m_Lifetime <= Now) {
+		TicketKeys->Rotate();
+	}
+
+	return true;
+}
+
+/**
+ * DecodeHex
+ *
+ * Decodes a hexadecimal string. Returns false if the string does not
+ * have the expected length.
+ *
+ * @param Hex the string
+ * @param Out buffer for the decoded bytes
+ * @param Length the number of bytes
+ */
+static bool DecodeHex(const char *Hex, unsigned char *Out, size_t Length) {
+	unsigned int Byte;
+
+	if (strlen(Hex) != Length * 2) {
+		return false;
+	}
+
+	for (size_t i = 0; i < Length; i++) {
+		if (!isxdigit(Hex[i * 2]) || !isxdigit(Hex[i * 2 + 1]) ||
+				sscanf(Hex + i * 2, "%2x", &Byte) != 1) {
+			return false;
+		}
+
+		Out[i] = (unsigned char)Byte;
+	}
+
+	return true;
+}
+
+/**
+ * WriteHex
+ *
+ * Writes bytes as a hexadecimal string.
+ *
+ * @param File the file
+ * @param Data the bytes
+ * @param Length the number of bytes
+ */
+static void WriteHex(FILE *File, const unsigned char *Data, size_t Length) {
+	for (size_t i = 0; i < Length; i++) {
+		fprintf(File, "%02x", Data[i]);
+	}
+}
+
+/**
+ * TicketKeyCallback
+ *
+ * Called by OpenSSL when a session ticket is encrypted or decrypted. This
+ * might happen on a worker thread.
+ *
+ * @param SSLObject the connection's SSL object
+ * @param Name the key name
+ * @param IV the initialization vector
+ * @param CipherContext the cipher context
+ * @param MACContext the HMAC context
+ * @param Encrypt whether a new ticket is encrypted
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int TicketKeyCallback(SSL *SSLObject, unsigned char *Name, unsigned char *IV,
+		EVP_CIPHER_CTX *CipherContext, EVP_MAC_CTX *MACContext, int Encrypt) {
+#else /* OPENSSL_VERSION_NUMBER */
+static int TicketKeyCallback(SSL *SSLObject, unsigned char *Name, unsigned char *IV,
+		EVP_CIPHER_CTX *CipherContext, HMAC_CTX *MACContext, int Encrypt) {
+#endif /* OPENSSL_VERSION_NUMBER */
+	CSSLTicketKeys *TicketKeys = g_Bouncer->GetSSLTicketKeys();
+	ticketkey_t Key;
+	bool Current;
+	int Result;
+
+	if (TicketKeys == NULL) {
+		return 0;
+	}
+
+	if (Encrypt) {
+		if (!TicketKeys->GetKey(NULL, &Key, &Current)) {
+			return -1;
+		}
+
+		if (RAND_bytes(IV, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+			return -1;
+		}
+
+		memcpy(Name, Key.Name, sizeof(Key.Name));
+
+		if (EVP_EncryptInit_ex(CipherContext, EVP_aes_256_cbc(), NULL, Key.AESKey, IV) != 1) {
+			return -1;
+		}
+
+		Result = 1;
+	} else {
+		// unknown (or expired) keys make OpenSSL perform a full handshake
+		if (!TicketKeys->GetKey(Name, &Key, &Current)) {
+			return 0;
+		}
+
+		if (EVP_DecryptInit_ex(CipherContext, EVP_aes_256_cbc(), NULL, Key.AESKey, IV) != 1) {
+			return -1;
+		}
+
+		// tickets which were encrypted with the previous key are renewed
+		Result = Current ? 1 : 2;
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	OSSL_PARAM Params[3];
+
+	Params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, Key.HMACKey, sizeof(Key.HMACKey));
+	Params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)"SHA256", 0);
+	Params[2] = OSSL_PARAM_construct_end();
+
+	if (EVP_MAC_CTX_set_params(MACContext, Params) != 1) {
+		Result = -1;
+	}
+#else /* OPENSSL_VERSION_NUMBER */
+	if (HMAC_Init_ex(MACContext, Key.HMACKey, sizeof(Key.HMACKey), EVP_sha256(), NULL) != 1) {
+		Result = -1;
+	}
+#endif /* OPENSSL_VERSION_NUMBER */
+
+	OPENSSL_cleanse(&Key, sizeof(Key));
+
+	return Result;
+}
+
+/**
+ * CSSLTicketKeys
+ *
+ * Constructs a new CSSLTicketKeys object and loads the keys from the
+ * specified file.
+ *
+ * @param Filename the file which the keys are stored in
+ * @param Lifetime the lifetime of tickets (in seconds)
+ */
+CSSLTicketKeys::CSSLTicketKeys(const char *Filename, unsigned int Lifetime) {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&m_Mutex, NULL);
+#endif /* HAVE_PTHREAD_H */
+
+	m_KeyCount = 0;
+	m_Lifetime = Lifetime;
+
+	m_Filename = strdup(Filename);
+
+	if (AllocFailed(m_Filename)) {
+		g_Bouncer->Fatal();
+	}
+
+	Load();
+
+	m_RotateTimer = new CTimer(60, true, TicketKeysRotateTimer, this);
+
+	TicketKeysRotateTimer(g_CurrentTime, this);
+}
+
+/**
+ * ~CSSLTicketKeys
+ *
+ * Destructs the CSSLTicketKeys object.
+ */
+CSSLTicketKeys::~CSSLTicketKeys(void) {
+	delete m_RotateTimer;
+
+	free(m_Filename);
+
+	OPENSSL_cleanse(m_Keys, sizeof(m_Keys));
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy(&m_Mutex);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/**
+ * Lock
+ *
+ * Locks the keys.
+ */
+void CSSLTicketKeys::Lock(void) {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&m_Mutex);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/**
+ * Unlock
+ *
+ * Unlocks the keys.
+ */
+void CSSLTicketKeys::Unlock(void) {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_unlock(&m_Mutex);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/**
+ * Load
+ *
+ * Loads the keys which have not expired yet from the key file. Each line
+ * contains the creation time, the name, the AES key and the HMAC key.
+ */
+void CSSLTicketKeys::Load(void) {
+	char Line[512], Name[64], AESKey[128], HMACKey[128];
+	long Created;
+	ticketkey_t Key;
+	FILE *KeyFile;
+
+	KeyFile = fopen(m_Filename, "r");
+
+	if (KeyFile == NULL) {
+		return;
+	}
+
+	while (m_KeyCount < TICKETKEYS_COUNT && fgets(Line, sizeof(Line), KeyFile) != NULL) {
+		if (sscanf(Line, "%ld %63s %127s %127s", &Created, Name, AESKey, HMACKey) != 4) {
+			continue;
+		}
+
+		if (!DecodeHex(Name, Key.Name, sizeof(Key.Name)) ||
+				!DecodeHex(AESKey, Key.AESKey, sizeof(Key.AESKey)) ||
+				!DecodeHex(HMACKey, Key.HMACKey, sizeof(Key.HMACKey))) {
+			continue;
+		}
+
+		Key.Created = Created;
+
+		// tickets which were encrypted with this key have expired
+		if (Key.Created + 2 * (time_t)m_Lifetime <= g_CurrentTime) {
+			continue;
+		}
+
+		m_Keys[m_KeyCount++] = Key;
+	}
+
+	OPENSSL_cleanse(&Key, sizeof(Key));
+	OPENSSL_cleanse(Line, sizeof(Line));
+	OPENSSL_cleanse(AESKey, sizeof(AESKey));
+	OPENSSL_cleanse(HMACKey, sizeof(HMACKey));
+
+	fclose(KeyFile);
+}
+
+/**
+ * Save
+ *
+ * Saves the keys to the key file.
+ */
+bool CSSLTicketKeys::Save(void) {
+	char *Filename;
+	FILE *KeyFile;
+	int rc;
+#ifndef _WIN32
+	int fd;
+#endif
+
+	rc = asprintf(&Filename, "%s.tmp", m_Filename);
+
+	if (RcFailed(rc)) {
+		return false;
+	}
+
+	// a stale temporary file might have been created by someone else
+	unlink(Filename);
+
+#ifndef _WIN32
+	// the file must never be accessible by other users, not even until
+	// its permissions would have been changed
+	fd = open(Filename, O_WRONLY | O_CREAT | O_TRUNC | O_EXCL, S_IRUSR | S_IWUSR);
+
+	if (fd == -1) {
+		free(Filename);
+
+		return false;
+	}
+
+	KeyFile = fdopen(fd, "w");
+
+	if (KeyFile == NULL) {
+		close(fd);
+		unlink(Filename);
+		free(Filename);
+
+		return false;
+	}
+#else
+	KeyFile = fopen(Filename, "w");
+
+	if (KeyFile == NULL) {
+		free(Filename);
+
+		return false;
+	}
+#endif
+
+	for (int i = 0; i < m_KeyCount; i++) {
+		fprintf(KeyFile, "%ld ", (long)m_Keys[i].Created);
+		WriteHex(KeyFile, m_Keys[i].Name, sizeof(m_Keys[i].Name));
+		fputc(' ', KeyFile);
+		WriteHex(KeyFile, m_Keys[i].AESKey, sizeof(m_Keys[i].AESKey));
+		fputc(' ', KeyFile);
+		WriteHex(KeyFile, m_Keys[i].HMACKey, sizeof(m_Keys[i].HMACKey));
+		fputc('\n', KeyFile);
+	}
+
+	fclose(KeyFile);
+
+#ifdef _WIN32
+	unlink(m_Filename);
+#endif
+
+	rc = rename(Filename, m_Filename);
+
+	if (RcFailed(rc)) {
+		unlink(Filename);
+	}
+
+	free(Filename);
+
+	return (rc == 0);
+}
+
+/**
+ * Rotate
+ *
+ * Creates a new key for encrypting tickets. The previous key is kept
+ * for decrypting existing tickets.
+ */
+bool CSSLTicketKeys::Rotate(void) {
+	ticketkey_t Key;
+
+	if (RAND_bytes(Key.Name, sizeof(Key.Name)) != 1 ||
+			RAND_bytes(Key.AESKey, sizeof(Key.AESKey)) != 1 ||
+			RAND_bytes(Key.HMACKey, sizeof(Key.HMACKey)) != 1) {
+		g_Bouncer->Log("Could not create a new key for SSL session tickets.");
+
+		return false;
+	}
+
+	Key.Created = g_CurrentTime;
+
+	Lock();
+
+	memmove(&m_Keys[1], &m_Keys[0], sizeof(ticketkey_t) * (TICKETKEYS_COUNT - 1));
+	m_Keys[0] = Key;
+
+	if (m_KeyCount < TICKETKEYS_COUNT) {
+		m_KeyCount++;
+	}
+
+	Unlock();
+
+	OPENSSL_cleanse(&Key, sizeof(Key));
+
+	if (!Save()) {
+		g_Bouncer->Log("Could not save the SSL session ticket keys (%s).", m_Filename);
+	}
+
+	return true;
+}
+
+/**
+ * GetKey
+ *
+ * Looks up a key.
+ *
+ * @param Name the key's name (or NULL for the current key)
+ * @param Key returns the key
+ * @param Current returns whether the key is the current key
+ */
+bool CSSLTicketKeys::GetKey(const unsigned char *Name, ticketkey_t *Key, bool *Current) {
+	bool Found = false;
+
+	Lock();
+
+	for (int i = 0; i < m_KeyCount; i++) {
+		if (Name == NULL || memcmp(m_Keys[i].Name, Name, sizeof(m_Keys[i].Name)) == 0) {
+			*Key = m_Keys[i];
+			*Current = (i == 0);
+			Found = true;
+
+			break;
+		}
+	}
+
+	Unlock();
+
+	return Found;
+}
+
+/**
+ * Install
+ *
+ * Lets an SSL context use the keys for session tickets.
+ *
+ * @param Context the SSL context
+ */
+void CSSLTicketKeys::Install(SSL_CTX *Context) {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	SSL_CTX_set_tlsext_ticket_key_evp_cb(Context, TicketKeyCallback);
+#else /* OPENSSL_VERSION_NUMBER */
+	SSL_CTX_set_tlsext_ticket_key_cb(Context, TicketKeyCallback);
+#endif /* OPENSSL_VERSION_NUMBER */
+}
+
+#endif /* HAVE_LIBSSL */
@@ -0,0 +1,82 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef SSLTICKETKEYS_H
+#define SSLTICKETKEYS_H
+
+#ifdef HAVE_LIBSSL
+
+#define TICKETKEYS_COUNT 2 /**< the number of keys which are accepted for
+							decrypting tickets (the current and the previous key) */
+
+/**
+ * ticketkey_t
+ *
+ * A key for encrypting TLS session tickets.
+ */
+typedef struct ticketkey_s {
+	unsigned char Name[16]; /**< identifies the key in a ticket */
+	unsigned char AESKey[32]; /**< the key for encrypting tickets */
+	unsigned char HMACKey[32]; /**< the key for authenticating tickets */
+	time_t Created; /**< when the key was created */
+} ticketkey_t;
+
+/**
+ * CSSLTicketKeys
+ *
+ * Manages the keys for TLS session tickets. Keys are rotated after one
+ * ticket lifetime and the previous key is kept for decrypting tickets which
+ * are still valid. The keys are saved to a file so that clients can resume
+ * their sessions after the bouncer was restarted.
+ */
+class SBNCAPI CSSLTicketKeys {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t m_Mutex; /**< protects m_Keys (tickets might be encrypted
+							 or decrypted on worker threads) */
+#endif /* HAVE_PTHREAD_H */
+	ticketkey_t m_Keys[TICKETKEYS_COUNT]; /**< the keys, the first one is used for new tickets */
+	int m_KeyCount; /**< the number of valid keys */
+	char *m_Filename; /**< the file which the keys are stored in */
+	unsigned int m_Lifetime; /**< the lifetime of tickets (in seconds) */
+	CTimer *m_RotateTimer; /**< checks whether the current key has to be replaced */
+
+	void Lock(void);
+	void Unlock(void);
+
+	void Load(void);
+	bool Save(void);
+
+	friend bool TicketKeysRotateTimer(time_t Now, void *Keys);
+
+public:
+#ifndef SWIG
+	CSSLTicketKeys(const char *Filename, unsigned int Lifetime);
+	virtual ~CSSLTicketKeys(void);
+#endif /* SWIG */
+
+	bool Rotate(void);
+
+	bool GetKey(const unsigned char *Name, ticketkey_t *Key, bool *Current);
+
+	void Install(SSL_CTX *Context);
+};
+
+#endif /* HAVE_LIBSSL */
+
+#endif /* SSLTICKETKEYS_H */
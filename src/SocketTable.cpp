@@ -0,0 +1,460 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+/**
+ * DestroySocketClass
+ *
+ * Frees a socket class.
+ *
+ * @param Class the class
+ */
+static void DestroySocketClass(socketclass_t *Class) {
+	free(Class->Name);
+	free(Class->Slots);
+	free(Class);
+}
+
+/**
+ * CSocketTable
+ *
+ * Constructs a new socket table.
+ *
+ * @param Capacity the maximum number of sockets
+ */
+CSocketTable::CSocketTable(int Capacity) {
+	int i, BucketCount = 1;
+
+	while (BucketCount < Capacity) {
+		BucketCount <<= 1;
+	}
+
+	m_Capacity = Capacity;
+	m_BucketMask = BucketCount - 1;
+
+	m_PollFds.Preallocate(Capacity);
+
+	m_Sockets = (socket_t *)calloc(Capacity, sizeof(socket_t));
+	m_FreeSlots = (int *)malloc(Capacity * sizeof(int));
+	m_FreeCount = 0;
+
+	m_FdBuckets = (int *)malloc(BucketCount * sizeof(int));
+	m_FdNext = (int *)malloc(Capacity * sizeof(int));
+	m_EventsBuckets = (int *)malloc(BucketCount * sizeof(int));
+	m_EventsNext = (int *)malloc(Capacity * sizeof(int));
+
+	m_SlotClass = (socketclass_t **)calloc(Capacity, sizeof(socketclass_t *));
+	m_ClassIndex = (int *)malloc(Capacity * sizeof(int));
+
+	m_DirtySlots = (int *)malloc(Capacity * sizeof(int));
+	m_DirtyCount = 0;
+	m_Dirty = (bool *)calloc(Capacity, sizeof(bool));
+
+	if (AllocFailed(m_Sockets) || AllocFailed(m_FreeSlots) || AllocFailed(m_FdBuckets) ||
+			AllocFailed(m_FdNext) || AllocFailed(m_EventsBuckets) || AllocFailed(m_EventsNext) ||
+			AllocFailed(m_SlotClass) || AllocFailed(m_ClassIndex) || AllocFailed(m_DirtySlots) ||
+			AllocFailed(m_Dirty)) {
+		g_Bouncer->Fatal();
+	}
+
+	for (i = 0; i < BucketCount; i++) {
+		m_FdBuckets[i] = -1;
+		m_EventsBuckets[i] = -1;
+	}
+
+	m_Unclassified.Name = NULL;
+	m_Unclassified.Slots = NULL;
+	m_Unclassified.Count = 0;
+	m_Unclassified.AllocCount = 0;
+
+	m_Classes.RegisterValueDestructor(DestroySocketClass);
+}
+
+/**
+ * ~CSocketTable
+ *
+ * Destructs a socket table.
+ */
+CSocketTable::~CSocketTable(void) {
+	free(m_Sockets);
+	free(m_FreeSlots);
+	free(m_FdBuckets);
+	free(m_FdNext);
+	free(m_EventsBuckets);
+	free(m_EventsNext);
+	free(m_SlotClass);
+	free(m_ClassIndex);
+	free(m_DirtySlots);
+	free(m_Dirty);
+	free(m_Unclassified.Slots);
+}
+
+/**
+ * HashFd
+ *
+ * Returns the bucket for a socket descriptor. Descriptors are allocated
+ * sequentially on most systems, so this is usually a direct index.
+ *
+ * @param Socket the socket
+ */
+unsigned int CSocketTable::HashFd(SOCKET Socket) const {
+	return (unsigned int)Socket & m_BucketMask;
+}
+
+/**
+ * HashEvents
+ *
+ * Returns the bucket for an event interface.
+ *
+ * @param Events the event interface
+ */
+unsigned int CSocketTable::HashEvents(CSocketEvents *Events) const {
+	return (unsigned int)((size_t)Events / sizeof(void *)) & m_BucketMask;
+}
+
+/**
+ * Unlink
+ *
+ * Removes a slot from a hash bucket's chain.
+ *
+ * @param Buckets the buckets
+ * @param Next the chain links
+ * @param Bucket the bucket
+ * @param Slot the slot
+ */
+void CSocketTable::Unlink(int *Buckets, int *Next, unsigned int Bucket, int Slot) {
+	int *Link = &Buckets[Bucket];
+
+	while (*Link != -1) {
+		if (*Link == Slot) {
+			*Link = Next[Slot];
+
+			return;
+		}
+
+		Link = &Next[*Link];
+	}
+}
+
+/**
+ * AddToClass
+ *
+ * Adds a slot to a socket class.
+ *
+ * @param Class the class
+ * @param Slot the slot
+ */
+bool CSocketTable::AddToClass(socketclass_t *Class, int Slot) {
+	if (Class->Count == Class->AllocCount) {
+		int NewCount = (Class->AllocCount == 0) ? 4 : Class->AllocCount * 2;
+		int *NewSlots = (int *)realloc(Class->Slots, NewCount * sizeof(int));
+
+		if (AllocFailed(NewSlots)) {
+			return false;
+		}
+
+		Class->Slots = NewSlots;
+		Class->AllocCount = NewCount;
+	}
+
+	m_SlotClass[Slot] = Class;
+	m_ClassIndex[Slot] = Class->Count;
+	Class->Slots[Class->Count++] = Slot;
+
+	return true;
+}
+
+/**
+ * RemoveFromClass
+ *
+ * Removes a slot from its socket class. The last socket of the class
+ * takes its place.
+ *
+ * @param Slot the slot
+ */
+void CSocketTable::RemoveFromClass(int Slot) {
+	socketclass_t *Class = m_SlotClass[Slot];
+	int Index, Last;
+
+	if (Class == NULL) {
+		return;
+	}
+
+	Index = m_ClassIndex[Slot];
+	Last = Class->Slots[--Class->Count];
+
+	Class->Slots[Index] = Last;
+	m_ClassIndex[Last] = Index;
+
+	m_SlotClass[Slot] = NULL;
+}
+
+/**
+ * ClassifySockets
+ *
+ * Sorts newly registered sockets into their classes. This can't be done
+ * in Add() because sockets are usually registered by the constructor of a
+ * base class, so GetClassName() would not return the final class name.
+ */
+void CSocketTable::ClassifySockets(void) {
+	for (int i = 0; i < m_Unclassified.Count; i++) {
+		int Slot = m_Unclassified.Slots[i];
+		const char *Name = m_Sockets[Slot].Events->GetClassName();
+		socketclass_t *Class = m_Classes.Get(Name);
+
+		if (Class == NULL) {
+			Class = (socketclass_t *)malloc(sizeof(socketclass_t));
+
+			if (AllocFailed(Class)) {
+				g_Bouncer->Fatal();
+			}
+
+			Class->Name = strdup(Name);
+
+			if (AllocFailed(Class->Name)) {
+				g_Bouncer->Fatal();
+			}
+
+			Class->Slots = NULL;
+			Class->Count = 0;
+			Class->AllocCount = 0;
+
+			if (!m_Classes.Add(Name, Class)) {
+				g_Bouncer->Fatal();
+			}
+		}
+
+		if (!AddToClass(Class, Slot)) {
+			g_Bouncer->Fatal();
+		}
+	}
+
+	m_Unclassified.Count = 0;
+}
+
+/**
+ * Add
+ *
+ * Adds a socket to the table and returns its entry (or NULL if there are
+ * no free slots left).
+ *
+ * @param Socket the socket
+ * @param Events the event interface for the socket
+ */
+socket_t *CSocketTable::Add(SOCKET Socket, CSocketEvents *Events) {
+	pollfd *PollFd;
+	unsigned int Bucket;
+	int Slot;
+
+	if (m_FreeCount > 0) {
+		Slot = m_FreeSlots[--m_FreeCount];
+	} else {
+		pollfd NewPollFd;
+
+		NewPollFd.fd = INVALID_SOCKET;
+		NewPollFd.events = 0;
+		NewPollFd.revents = 0;
+
+		if (!m_PollFds.Insert(NewPollFd)) {
+			return NULL;
+		}
+
+		Slot = m_PollFds.GetLength() - 1;
+	}
+
+	// the pollfd vector is pre-allocated, so its addresses are stable
+	PollFd = m_PollFds.GetAddressOf(Slot);
+	m_Sockets[Slot].PollFd = PollFd;
+
+	if (!AddToClass(&m_Unclassified, Slot)) {
+		m_FreeSlots[m_FreeCount++] = Slot;
+
+		return NULL;
+	}
+
+	PollFd->fd = Socket;
+	PollFd->events = POLLIN | POLLERR;
+	PollFd->revents = 0;
+
+	m_Sockets[Slot].Events = Events;
+
+	Bucket = HashFd(Socket);
+	m_FdNext[Slot] = m_FdBuckets[Bucket];
+	m_FdBuckets[Bucket] = Slot;
+
+	Bucket = HashEvents(Events);
+	m_EventsNext[Slot] = m_EventsBuckets[Bucket];
+	m_EventsBuckets[Bucket] = Slot;
+
+	MarkDirty(&m_Sockets[Slot]);
+
+	return &m_Sockets[Slot];
+}
+
+/**
+ * Remove
+ *
+ * Removes a socket from the table. The entry remains valid memory but
+ * its descriptor is set to INVALID_SOCKET until the slot is re-used.
+ *
+ * @param Socket the socket's entry
+ */
+void CSocketTable::Remove(socket_t *Socket) {
+	int Slot = (int)(Socket - m_Sockets);
+
+	Unlink(m_FdBuckets, m_FdNext, HashFd(Socket->PollFd->fd), Slot);
+	Unlink(m_EventsBuckets, m_EventsNext, HashEvents(Socket->Events), Slot);
+	RemoveFromClass(Slot);
+
+	Socket->PollFd->fd = INVALID_SOCKET;
+	Socket->PollFd->events = 0;
+	Socket->PollFd->revents = 0;
+	Socket->Events = NULL;
+
+	m_FreeSlots[m_FreeCount++] = Slot;
+}
+
+/**
+ * GetByFd
+ *
+ * Returns the entry for a socket descriptor (or NULL if the socket is
+ * not registered).
+ *
+ * @param Socket the socket
+ */
+socket_t *CSocketTable::GetByFd(SOCKET Socket) const {
+	for (int Slot = m_FdBuckets[HashFd(Socket)]; Slot != -1; Slot = m_FdNext[Slot]) {
+		if (m_Sockets[Slot].PollFd->fd == Socket) {
+			return &m_Sockets[Slot];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * GetByEvents
+ *
+ * Returns the entry for an event interface (or NULL if the event
+ * interface is not registered).
+ *
+ * @param Events the event interface
+ */
+socket_t *CSocketTable::GetByEvents(CSocketEvents *Events) const {
+	for (int Slot = m_EventsBuckets[HashEvents(Events)]; Slot != -1; Slot = m_EventsNext[Slot]) {
+		if (m_Sockets[Slot].Events == Events) {
+			return &m_Sockets[Slot];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * GetByClass
+ *
+ * Returns a socket which belongs to a specific class (or NULL if there
+ * is no such socket).
+ *
+ * @param Class the class name
+ * @param Index the index of the socket within its class
+ */
+socket_t *CSocketTable::GetByClass(const char *Class, int Index) {
+	socketclass_t *SocketClass;
+
+	ClassifySockets();
+
+	SocketClass = m_Classes.Get(Class);
+
+	if (SocketClass == NULL || Index < 0 || Index >= SocketClass->Count) {
+		return NULL;
+	}
+
+	return &m_Sockets[SocketClass->Slots[Index]];
+}
+
+/**
+ * MarkDirty
+ *
+ * Marks a socket whose requested events might have changed. Slots which
+ * are freed while they're marked remain in the list until the next call
+ * to TakeDirtySocket(), so each slot is in the list at most once.
+ *
+ * @param Socket the socket's entry
+ */
+void CSocketTable::MarkDirty(socket_t *Socket) {
+	int Slot = (int)(Socket - m_Sockets);
+
+	if (!m_Dirty[Slot]) {
+		m_Dirty[Slot] = true;
+		m_DirtySlots[m_DirtyCount++] = Slot;
+	}
+}
+
+/**
+ * TakeDirtySocket
+ *
+ * Removes a socket from the list of dirty sockets and returns it (or
+ * NULL if there are no dirty sockets left).
+ */
+socket_t *CSocketTable::TakeDirtySocket(void) {
+	while (m_DirtyCount > 0) {
+		int Slot = m_DirtySlots[--m_DirtyCount];
+
+		m_Dirty[Slot] = false;
+
+		if (m_Sockets[Slot].PollFd->fd != INVALID_SOCKET) {
+			return &m_Sockets[Slot];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * GetSlotCount
+ *
+ * Returns the number of slots which are currently in use or have been
+ * used before. Slots beyond this number are unused.
+ */
+int CSocketTable::GetSlotCount(void) const {
+	return m_PollFds.GetLength();
+}
+
+/**
+ * GetSlot
+ *
+ * Returns the entry for a slot. The entry's descriptor is INVALID_SOCKET
+ * if the slot is not in use.
+ *
+ * @param Slot the slot
+ */
+socket_t *CSocketTable::GetSlot(int Slot) const {
+	return &m_Sockets[Slot];
+}
+
+/**
+ * GetPollFds
+ *
+ * Returns the pollfd structures for all slots.
+ */
+CVector<pollfd> *CSocketTable::GetPollFds(void) {
+	return &m_PollFds;
+}
@@ -0,0 +1,95 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef SOCKETTABLE_H
+#define SOCKETTABLE_H
+
+/**
+ * socketclass_t
+ *
+ * The registered sockets which belong to a specific class.
+ */
+typedef struct socketclass_s {
+	char *Name; /**< the name of the class */
+	int *Slots; /**< the sockets' slots */
+	int Count; /**< the number of sockets */
+	int AllocCount; /**< the number of allocated items */
+} socketclass_t;
+
+/**
+ * CSocketTable
+ *
+ * Keeps track of the registered sockets. Each socket uses one of a fixed
+ * number of slots; a socket's slot number is also the index of its pollfd
+ * structure. Sockets can be looked up by descriptor, by event interface and
+ * by class in constant time.
+ */
+class SBNCAPI CSocketTable {
+	CVector<pollfd> m_PollFds; /**< the pollfd structures, indexed by slot */
+	socket_t *m_Sockets; /**< the sockets, indexed by slot */
+	int m_Capacity; /**< the number of slots */
+
+	int *m_FreeSlots; /**< slots which can be re-used */
+	int m_FreeCount; /**< the number of free slots */
+
+	int m_BucketMask; /**< the number of hash buckets minus one */
+	int *m_FdBuckets; /**< first slot for each descriptor bucket */
+	int *m_FdNext; /**< next slot in the same descriptor bucket */
+	int *m_EventsBuckets; /**< first slot for each event interface bucket */
+	int *m_EventsNext; /**< next slot in the same event interface bucket */
+
+	CHashtable<socketclass_t *, true> m_Classes; /**< socket classes */
+	socketclass_t m_Unclassified; /**< sockets which have not been classified yet */
+	socketclass_t **m_SlotClass; /**< the class for each slot */
+	int *m_ClassIndex; /**< the index of each slot in its class */
+
+	int *m_DirtySlots; /**< slots whose requested events need to be updated */
+	int m_DirtyCount; /**< the number of dirty slots */
+	bool *m_Dirty; /**< whether a slot is in the m_DirtySlots list */
+
+	unsigned int HashFd(SOCKET Socket) const;
+	unsigned int HashEvents(CSocketEvents *Events) const;
+
+	void Unlink(int *Buckets, int *Next, unsigned int Bucket, int Slot);
+
+	bool AddToClass(socketclass_t *Class, int Slot);
+	void RemoveFromClass(int Slot);
+	void ClassifySockets(void);
+public:
+#ifndef SWIG
+	CSocketTable(int Capacity);
+	virtual ~CSocketTable(void);
+#endif /* SWIG */
+
+	socket_t *Add(SOCKET Socket, CSocketEvents *Events);
+	void Remove(socket_t *Socket);
+
+	socket_t *GetByFd(SOCKET Socket) const;
+	socket_t *GetByEvents(CSocketEvents *Events) const;
+	socket_t *GetByClass(const char *Class, int Index);
+
+	void MarkDirty(socket_t *Socket);
+	socket_t *TakeDirtySocket(void);
+
+	int GetSlotCount(void) const;
+	socket_t *GetSlot(int Slot) const;
+	CVector<pollfd> *GetPollFds(void);
+};
+
+#endif /* SOCKETTABLE_H */
@@ -86,6 +86,10 @@ typedef lt_dlhandle HMODULE;
 #	include <openssl/ssl.h>
 #	include <openssl/md5.h>
 #	include <openssl/err.h>
+#	include <openssl/rand.h>
+#	if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#		include <openssl/core_names.h>
+#	endif /* OPENSSL_VERSION_NUMBER */
 #else /* HAVE_LIBSSL */
 typedef void SSL;
 typedef void BIO;
@@ -115,7 +119,9 @@ typedef void X509_STORE_CTX;
 #	include "Vector.h"
 #	include "List.h"
 #	include "Hashtable.h"
+#	include "CaseMapping.h"
 #	include "utility.h"
+#	include "Commands.h"
 #	include "SocketEvents.h"
 #	include "DnsSocket.h"
 #	include "DnsEvents.h"
@@ -126,6 +132,10 @@ typedef void X509_STORE_CTX;
 #	include "Config.h"
 #	include "Cache.h"
 #	include "Core.h"
+#	include "SocketTable.h"
+#	include "EventBackend.h"
+#	include "ThreadPool.h"
+#	include "SSLTicketKeys.h"
 #	include "ClientConnection.h"
 #	include "ClientConnectionMultiplexer.h"
 #	include "IRCConnection.h"
@@ -0,0 +1,337 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#include "StdAfx.h"
+
+#ifdef HAVE_PTHREAD_H
+/**
+ * CThreadPoolNotifier
+ *
+ * Event interface for the pipe which the worker threads use to notify the
+ * main loop about finished work items.
+ */
+class CThreadPoolNotifier : public CSocketEvents {
+	CThreadPool *m_Pool; /**< the thread pool */
+	int m_Pipe; /**< the read end of the pipe */
+
+public:
+	CThreadPoolNotifier(CThreadPool *Pool, int Pipe) {
+		m_Pool = Pool;
+		m_Pipe = Pipe;
+
+		g_Bouncer->RegisterSocket(m_Pipe, this);
+	}
+
+	virtual ~CThreadPoolNotifier(void) {
+		g_Bouncer->UnregisterSocket(m_Pipe);
+	}
+
+	virtual void Destroy(void) { }
+
+	virtual int Read(bool DontProcess) {
+		char Buffer[64];
+
+		while (read(m_Pipe, Buffer, sizeof(Buffer)) > 0)
+			; // empty
+
+		m_Pool->ProcessFinished();
+
+		return 0;
+	}
+
+	virtual int Write(void) { return 0; }
+	virtual void Error(int ErrorCode) { }
+	virtual bool HasQueuedData(void) const { return false; }
+	virtual bool ShouldDestroy(void) const { return false; }
+
+	virtual const char *GetClassName(void) const { return "CThreadPoolNotifier"; }
+};
+#endif /* HAVE_PTHREAD_H */
+
+/**
+ * CThreadPool
+ *
+ * Constructs a new thread pool. Fewer threads than requested may be
+ * available if a thread could not be created (see GetThreadCount()).
+ *
+ * @param Threads the number of worker threads
+ */
+CThreadPool::CThreadPool(int Threads) {
+	m_ThreadCount = 0;
+
+#ifdef HAVE_PTHREAD_H
+	sigset_t Signals, OldSignals;
+
+	m_Pending = NULL;
+	m_PendingTail = NULL;
+	m_Finished = NULL;
+	m_FinishedTail = NULL;
+	m_Shutdown = false;
+	m_Notifier = NULL;
+
+	pthread_mutex_init(&m_Mutex, NULL);
+	pthread_cond_init(&m_Cond, NULL);
+
+	if (pipe(m_Pipe) != 0) {
+		m_Pipe[0] = m_Pipe[1] = -1;
+		m_Threads = NULL;
+
+		return;
+	}
+
+	fcntl(m_Pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(m_Pipe[1], F_SETFL, O_NONBLOCK);
+	fcntl(m_Pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(m_Pipe[1], F_SETFD, FD_CLOEXEC);
+
+	m_Notifier = new CThreadPoolNotifier(this, m_Pipe[0]);
+
+	m_Threads = (pthread_t *)malloc(sizeof(pthread_t) * Threads);
+
+	if (AllocFailed(m_Threads)) {
+		return;
+	}
+
+	// signals are handled by the main thread only
+	sigfillset(&Signals);
+	pthread_sigmask(SIG_SETMASK, &Signals, &OldSignals);
+
+	for (int i = 0; i < Threads; i++) {
+		if (pthread_create(&m_Threads[m_ThreadCount], NULL, WorkerThread, this) != 0) {
+			break;
+		}
+
+		m_ThreadCount++;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &OldSignals, NULL);
+#endif /* HAVE_PTHREAD_H */
+}
+
+/**
+ * ~CThreadPool
+ *
+ * Destructs a thread pool. Work items which are currently being executed
+ * are finished; the completion functions for all remaining work items are
+ * called with Cancelled set to true.
+ */
+CThreadPool::~CThreadPool(void) {
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&m_Mutex);
+	m_Shutdown = true;
+	pthread_cond_broadcast(&m_Cond);
+	pthread_mutex_unlock(&m_Mutex);
+
+	for (int i = 0; i < m_ThreadCount; i++) {
+		pthread_join(m_Threads[i], NULL);
+	}
+
+	free(m_Threads);
+
+	threadwork_t *Lists[] = { m_Finished, m_Pending };
+
+	for (unsigned int i = 0; i < sizeof(Lists) / sizeof(Lists[0]); i++) {
+		threadwork_t *Item = Lists[i];
+
+		while (Item != NULL) {
+			threadwork_t *Next = Item->Next;
+
+			Item->Done(Item->Cookie, true);
+			free(Item);
+
+			Item = Next;
+		}
+	}
+
+	delete m_Notifier;
+
+	if (m_Pipe[0] != -1) {
+		close(m_Pipe[0]);
+		close(m_Pipe[1]);
+	}
+
+	pthread_cond_destroy(&m_Cond);
+	pthread_mutex_destroy(&m_Mutex);
+#endif /* HAVE_PTHREAD_H */
+}
+
+#ifdef HAVE_PTHREAD_H
+/**
+ * WorkerThread
+ *
+ * The main function for the worker threads.
+ *
+ * @param Pool the thread pool
+ */
+void *CThreadPool::WorkerThread(void *Pool) {
+	CThreadPool *Self = (CThreadPool *)Pool;
+
+	pthread_mutex_lock(&Self->m_Mutex);
+
+	while (true) {
+		while (!Self->m_Shutdown && Self->m_Pending == NULL) {
+			pthread_cond_wait(&Self->m_Cond, &Self->m_Mutex);
+		}
+
+		if (Self->m_Shutdown) {
+			break;
+		}
+
+		threadwork_t *Item = Self->m_Pending;
+
+		Self->m_Pending = Item->Next;
+
+		if (Self->m_Pending == NULL) {
+			Self->m_PendingTail = NULL;
+		}
+
+		pthread_mutex_unlock(&Self->m_Mutex);
+
+		Item->Work(Item->Cookie);
+
+		pthread_mutex_lock(&Self->m_Mutex);
+
+		bool WasEmpty = (Self->m_Finished == NULL);
+
+		Item->Next = NULL;
+
+		if (Self->m_FinishedTail != NULL) {
+			Self->m_FinishedTail->Next = Item;
+		} else {
+			Self->m_Finished = Item;
+		}
+
+		Self->m_FinishedTail = Item;
+
+		// the main loop only needs to be woken up once per batch
+		if (WasEmpty) {
+			write(Self->m_Pipe[1], "", 1);
+		}
+	}
+
+	pthread_mutex_unlock(&Self->m_Mutex);
+
+	return NULL;
+}
+#endif /* HAVE_PTHREAD_H */
+
+/**
+ * GetThreadCount
+ *
+ * Returns the number of worker threads.
+ */
+int CThreadPool::GetThreadCount(void) const {
+	return m_ThreadCount;
+}
+
+/**
+ * Queue
+ *
+ * Queues a work item. The work function is called on one of the worker
+ * threads; afterwards the completion function is called by the main loop.
+ * If there are no worker threads both functions are called before Queue()
+ * returns, and NULL is returned instead of the work item.
+ *
+ * @param Work the work function
+ * @param Done the completion function
+ * @param Cookie a cookie which is passed to both functions
+ */
+threadwork_t *CThreadPool::Queue(ThreadWorkProc Work, ThreadDoneProc Done, void *Cookie) {
+	threadwork_t *Item;
+
+	if (m_ThreadCount == 0) {
+		Work(Cookie);
+		Done(Cookie, false);
+
+		return NULL;
+	}
+
+	Item = (threadwork_t *)malloc(sizeof(threadwork_t));
+
+	if (AllocFailed(Item)) {
+		Work(Cookie);
+		Done(Cookie, false);
+
+		return NULL;
+	}
+
+	Item->Next = NULL;
+	Item->Work = Work;
+	Item->Done = Done;
+	Item->Cookie = Cookie;
+	Item->Cancelled = false;
+
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_lock(&m_Mutex);
+
+	if (m_PendingTail != NULL) {
+		m_PendingTail->Next = Item;
+	} else {
+		m_Pending = Item;
+	}
+
+	m_PendingTail = Item;
+
+	pthread_cond_signal(&m_Cond);
+	pthread_mutex_unlock(&m_Mutex);
+#endif /* HAVE_PTHREAD_H */
+
+	return Item;
+}
+
+/**
+ * Cancel
+ *
+ * Cancels a work item. The work function might still be executed,
+ * however the completion function is called with Cancelled set to true,
+ * so it knows that the object which queued the item no longer exists.
+ *
+ * @param Item the work item
+ */
+void CThreadPool::Cancel(threadwork_t *Item) {
+	// only the main thread uses this flag
+	Item->Cancelled = true;
+}
+
+/**
+ * ProcessFinished
+ *
+ * Calls the completion functions for finished work items. This function
+ * is called by the main loop.
+ */
+void CThreadPool::ProcessFinished(void) {
+#ifdef HAVE_PTHREAD_H
+	threadwork_t *Item;
+
+	pthread_mutex_lock(&m_Mutex);
+	Item = m_Finished;
+	m_Finished = NULL;
+	m_FinishedTail = NULL;
+	pthread_mutex_unlock(&m_Mutex);
+
+	while (Item != NULL) {
+		threadwork_t *Next = Item->Next;
+
+		Item->Done(Item->Cookie, Item->Cancelled);
+		free(Item);
+
+		Item = Next;
+	}
+#endif /* HAVE_PTHREAD_H */
+}
@@ -0,0 +1,80 @@
+/******************************************************************************
+ * shroudBNC - an object-oriented framework for IRC                            *
+ * Copyright (C) 2005-2014 Gunnar Beutner                                      *
+ *                                                                             *
+ * This program is free software; you can redistribute it and/or               *
+ * modify it under the terms of the GNU General Public License                 *
+ * as published by the Free Software Foundation; either version 2              *
+ * of the License, or (at your option) any later version.                      *
+ *                                                                             *
+ * This program is distributed in the hope that it will be useful,             *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of              *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the               *
+ * GNU General Public License for more details.                                *
+ *                                                                             *
+ * You should have received a copy of the GNU General Public License           *
+ * along with this program; if not, write to the Free Software                 *
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA. *
+ *******************************************************************************/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+typedef void (*ThreadWorkProc)(void *Cookie);
+typedef void (*ThreadDoneProc)(void *Cookie, bool Cancelled);
+
+/**
+ * threadwork_t
+ *
+ * A work item for the thread pool.
+ */
+typedef struct threadwork_s {
+	struct threadwork_s *Next; /**< the next work item */
+	ThreadWorkProc Work; /**< the function which is called on a worker thread */
+	ThreadDoneProc Done; /**< the function which is called on the main thread */
+	void *Cookie; /**< the cookie for both functions */
+	bool Cancelled; /**< whether the work item was cancelled */
+} threadwork_t;
+
+class CThreadPoolNotifier;
+
+/**
+ * CThreadPool
+ *
+ * A pool of worker threads. Work items are executed on one of the worker
+ * threads; their completion functions are called by the main loop. Work
+ * functions must not use any of the bouncer's objects: everything which
+ * is not thread-safe has to happen in the completion function.
+ */
+class SBNCAPI CThreadPool {
+#ifdef HAVE_PTHREAD_H
+	pthread_t *m_Threads; /**< the worker threads */
+	pthread_mutex_t m_Mutex; /**< protects the work item lists and m_Shutdown */
+	pthread_cond_t m_Cond; /**< signalled when new work is queued */
+	threadwork_t *m_Pending; /**< work items which have not been started yet */
+	threadwork_t *m_PendingTail; /**< the last pending work item */
+	threadwork_t *m_Finished; /**< work items which are waiting for their completion function */
+	threadwork_t *m_FinishedTail; /**< the last finished work item */
+	bool m_Shutdown; /**< whether the worker threads should exit */
+	int m_Pipe[2]; /**< used for waking up the main loop */
+	CThreadPoolNotifier *m_Notifier; /**< the main loop's event interface for the pipe */
+
+	static void *WorkerThread(void *Pool);
+#endif /* HAVE_PTHREAD_H */
+	int m_ThreadCount; /**< the number of worker threads */
+
+public:
+#ifndef SWIG
+	CThreadPool(int Threads);
+	virtual ~CThreadPool(void);
+#endif /* SWIG */
+
+	int GetThreadCount(void) const;
+
+	threadwork_t *Queue(ThreadWorkProc Work, ThreadDoneProc Done, void *Cookie);
+	void Cancel(threadwork_t *Item);
+
+	void ProcessFinished(void);
+};
+
+#endif /* THREADPOOL_H */
@@ -19,8 +19,13 @@
 
 #include "StdAfx.h"
 
-static time_t g_NextCall = 0;
-static CList<CTimer *> *g_Timers = NULL;
+static CTimer **g_TimerHeap = NULL; /**< a binary min-heap of timers, ordered by m_Next */
+static int g_TimerCount = 0; /**< the number of timers in the heap */
+static int g_TimerAlloc = 0; /**< the number of allocated heap items */
+
+static CTimer **g_DueTimers = NULL; /**< timers which are called by the current CallTimers() */
+static int g_DueCount = 0; /**< the number of due timers */
+static int g_DueAlloc = 0; /**< the number of allocated due timer items */
 
 /**
  * CTimer
@@ -31,20 +36,17 @@ static CList<CTimer *> *g_Timers = NULL;
  * @param Repeat whether the timer should repeat itself
  * @param Function the timer's function
  * @param Cookie a timer-specific cookie
+ * @param Milliseconds whether the interval is specified in milliseconds
  */
-CTimer::CTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie) {
+CTimer::CTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie, bool Milliseconds) {
 	m_Interval = Interval; 
 	m_Repeat = Repeat;
+	m_Milliseconds = Milliseconds;
 	m_Proc = Function;
 	m_Cookie = Cookie;
+	m_Index = -1;
 
-	Reschedule(g_CurrentTime + Interval);
-
-	if (g_Timers == NULL) {
-		g_Timers = new CList<CTimer *>();
-	}
-
-	m_Link = g_Timers->Insert(this);
+	SetNext(g_MonotonicTime + GetIntervalMs());
 }
 
 /**
@@ -53,9 +55,11 @@ CTimer::CTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Coo
  * Destroys a timer.
  */
 CTimer::~CTimer(void) {
-	g_Timers->Remove(m_Link);
-
-	RescheduleTimers();
+	if (m_Index >= 0) {
+		HeapRemove(this);
+	} else if (m_Index <= -2) {
+		g_DueTimers[-2 - m_Index] = NULL;
+	}
 }
 
 /**
@@ -71,17 +75,25 @@ void CTimer::Destroy(void) {
  * Call
  *
  * Calls the timer's function
- *
- * @param Now the current time
  */
-bool CTimer::Call(time_t Now) {
+bool CTimer::Call(void) {
 	time_t ThisCall;
+	mtime_t Interval;
 	bool ReturnValue;
 
-	ThisCall = m_Next;
+	// the (wall clock) time the call was scheduled for
+	ThisCall = g_CurrentTime - (time_t)((g_MonotonicTime - m_Next) / 1000);
 
-	if (m_Interval != 0 && m_Repeat) {
-		Reschedule(Now + m_Interval);
+	if (m_Repeat) {
+		Interval = GetIntervalMs();
+
+		// repeating timers without an interval are called once per second
+		// (or millisecond) rather than in every iteration of the main loop
+		if (Interval == 0) {
+			Interval = m_Milliseconds ? 1 : 1000;
+		}
+
+		SetNext(g_MonotonicTime + Interval);
 	}
 
 	if (m_Proc == NULL) {
@@ -111,10 +123,26 @@ bool CTimer::Call(time_t Now) {
  * Returns the next scheduled time of execution.
  */
 time_t CTimer::GetNextCall(void) {
-	if (g_NextCall == 0) {
-		return g_CurrentTime + 120;
+	mtime_t Next = GetNextCallMonotonic();
+
+	if (Next <= g_MonotonicTime) {
+		return g_CurrentTime;
 	} else {
-		return g_NextCall;
+		return g_CurrentTime + (time_t)((Next - g_MonotonicTime + 999) / 1000);
+	}
+}
+
+/**
+ * GetNextCallMonotonic
+ *
+ * Returns the next scheduled time of execution as a monotonic time
+ * (in milliseconds).
+ */
+mtime_t CTimer::GetNextCallMonotonic(void) {
+	if (g_TimerCount == 0) {
+		return g_MonotonicTime + 120 * 1000;
+	} else {
+		return g_TimerHeap[0]->m_Next;
 	}
 }
 
@@ -136,6 +164,28 @@ bool CTimer::GetRepeat(void) const {
 	return m_Repeat;
 }
 
+/**
+ * GetMilliseconds
+ *
+ * Returns whether the timer's interval is specified in milliseconds.
+ */
+bool CTimer::GetMilliseconds(void) const {
+	return m_Milliseconds;
+}
+
+/**
+ * GetIntervalMs
+ *
+ * Returns the timer's interval in milliseconds.
+ */
+mtime_t CTimer::GetIntervalMs(void) const {
+	if (m_Milliseconds) {
+		return m_Interval;
+	} else {
+		return (mtime_t)m_Interval * 1000;
+	}
+}
+
 /**
  * Reschedule
  *
@@ -144,41 +194,206 @@ bool CTimer::GetRepeat(void) const {
  * @param Next the next call
  */
 void CTimer::Reschedule(time_t Next) {
+	if (Next <= g_CurrentTime) {
+		SetNext(g_MonotonicTime);
+	} else {
+		SetNext(g_MonotonicTime + (mtime_t)(Next - g_CurrentTime) * 1000);
+	}
+}
+
+/**
+ * SetNext
+ *
+ * Sets the timer's next call and updates the timer heap.
+ *
+ * @param Next the next call (monotonic time)
+ */
+void CTimer::SetNext(mtime_t Next) {
 	m_Next = Next;
 
-	if (Next < g_NextCall || g_NextCall == 0) {
-		g_NextCall = Next;
+	if (m_Index >= 0) {
+		HeapUpdate(this);
+	} else if (m_Index == -1) {
+		HeapInsert(this);
 	}
 }
 
 void CTimer::DestroyAllTimers(void) {
-	for (CListCursor<CTimer *> TimerCursor(g_Timers); TimerCursor.IsValid(); TimerCursor.Proceed()) {
-		delete *TimerCursor;
+	while (g_TimerCount > 0) {
+		delete g_TimerHeap[0];
 	}
 }
 
 void CTimer::CallTimers(void) {
-	g_NextCall = 0;
+	// due timers are collected first so timers which are scheduled by
+	// timer functions aren't called again in the same pass
+	g_DueCount = 0;
+
+	while (g_TimerCount > 0 && g_TimerHeap[0]->m_Next <= g_MonotonicTime) {
+		CTimer *Timer = g_TimerHeap[0];
+
+		if (g_DueCount == g_DueAlloc) {
+			int NewAlloc = (g_DueAlloc == 0) ? 16 : g_DueAlloc * 2;
+			CTimer **NewDueTimers = (CTimer **)realloc(g_DueTimers, NewAlloc * sizeof(CTimer *));
+
+			if (AllocFailed(NewDueTimers)) {
+				break;
+			}
+
+			g_DueTimers = NewDueTimers;
+			g_DueAlloc = NewAlloc;
+		}
+
+		HeapRemove(Timer);
+
+		Timer->m_Index = -2 - g_DueCount;
+		g_DueTimers[g_DueCount++] = Timer;
+	}
+
+	for (int i = 0; i < g_DueCount; i++) {
+		CTimer *Timer = g_DueTimers[i];
+
+		// the timer might have been destroyed by another timer's function
+		if (Timer == NULL) {
+			continue;
+		}
+
+		g_DueTimers[i] = NULL;
+		Timer->m_Index = -1;
+
+		// or it might have been rescheduled
+		if (Timer->m_Next > g_MonotonicTime) {
+			HeapInsert(Timer);
+
+			continue;
+		}
 
-	for (CListCursor<CTimer *> TimerCursor(g_Timers); TimerCursor.IsValid(); TimerCursor.Proceed()) {
-		if (g_CurrentTime >= (*TimerCursor)->m_Next) {
-			(*TimerCursor)->Call(g_CurrentTime);
-		} else if ((*TimerCursor)->m_Next < g_NextCall || g_NextCall == 0) {
-			g_NextCall = (*TimerCursor)->m_Next;
+		if (Timer->Call() && Timer->m_Index == -1) {
+			HeapInsert(Timer);
 		}
 	}
+
+	g_DueCount = 0;
+}
+
+/**
+ * HeapInsert
+ *
+ * Inserts a timer into the timer heap.
+ *
+ * @param Timer the timer
+ */
+void CTimer::HeapInsert(CTimer *Timer) {
+	if (g_TimerCount == g_TimerAlloc) {
+		int NewAlloc = (g_TimerAlloc == 0) ? 64 : g_TimerAlloc * 2;
+		CTimer **NewHeap = (CTimer **)realloc(g_TimerHeap, NewAlloc * sizeof(CTimer *));
+
+		if (AllocFailed(NewHeap)) {
+			g_Bouncer->Fatal();
+		}
+
+		g_TimerHeap = NewHeap;
+		g_TimerAlloc = NewAlloc;
+	}
+
+	Timer->m_Index = g_TimerCount;
+	g_TimerHeap[g_TimerCount++] = Timer;
+
+	HeapSiftUp(Timer->m_Index);
+}
+
+/**
+ * HeapRemove
+ *
+ * Removes a timer from the timer heap.
+ *
+ * @param Timer the timer
+ */
+void CTimer::HeapRemove(CTimer *Timer) {
+	int Index = Timer->m_Index;
+	CTimer *Last = g_TimerHeap[--g_TimerCount];
+
+	Timer->m_Index = -1;
+
+	if (Last == Timer) {
+		return;
+	}
+
+	g_TimerHeap[Index] = Last;
+	Last->m_Index = Index;
+
+	HeapUpdate(Last);
+}
+
+/**
+ * HeapUpdate
+ *
+ * Restores the heap order after a timer's next call has changed.
+ *
+ * @param Timer the timer
+ */
+void CTimer::HeapUpdate(CTimer *Timer) {
+	int Index = Timer->m_Index;
+
+	if (Index > 0 && g_TimerHeap[(Index - 1) / 2]->m_Next > Timer->m_Next) {
+		HeapSiftUp(Index);
+	} else {
+		HeapSiftDown(Index);
+	}
+}
+
+/**
+ * HeapSiftUp
+ *
+ * Moves a timer towards the top of the heap.
+ *
+ * @param Index the timer's index
+ */
+void CTimer::HeapSiftUp(int Index) {
+	CTimer *Timer = g_TimerHeap[Index];
+
+	while (Index > 0) {
+		int Parent = (Index - 1) / 2;
+
+		if (g_TimerHeap[Parent]->m_Next <= Timer->m_Next) {
+			break;
+		}
+
+		g_TimerHeap[Index] = g_TimerHeap[Parent];
+		g_TimerHeap[Index]->m_Index = Index;
+		Index = Parent;
+	}
+
+	g_TimerHeap[Index] = Timer;
+	Timer->m_Index = Index;
 }
 
-void CTimer::RescheduleTimers(void) {
-	time_t Best;
+/**
+ * HeapSiftDown
+ *
+ * Moves a timer towards the bottom of the heap.
+ *
+ * @param Index the timer's index
+ */
+void CTimer::HeapSiftDown(int Index) {
+	CTimer *Timer = g_TimerHeap[Index];
 
-	Best = g_CurrentTime + 120;
+	while (2 * Index + 1 < g_TimerCount) {
+		int Child = 2 * Index + 1;
 
-	for (CListCursor<CTimer *> TimerCursor(g_Timers); TimerCursor.IsValid(); TimerCursor.Proceed()) {
-		if ((*TimerCursor)->m_Next < Best) {
-			Best = (*TimerCursor)->m_Next;
+		if (Child + 1 < g_TimerCount && g_TimerHeap[Child + 1]->m_Next < g_TimerHeap[Child]->m_Next) {
+			Child++;
 		}
+
+		if (Timer->m_Next <= g_TimerHeap[Child]->m_Next) {
+			break;
+		}
+
+		g_TimerHeap[Index] = g_TimerHeap[Child];
+		g_TimerHeap[Index]->m_Index = Index;
+		Index = Child;
 	}
 
-	g_NextCall = Best;
+	g_TimerHeap[Index] = Timer;
+	Timer->m_Index = Index;
 }
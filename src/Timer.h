@@ -33,24 +33,35 @@ private:
 	void *m_Cookie; /**< a user-specific pointer which is passed to the timer's function */
 	unsigned int m_Interval; /**< the timer's interval */
 	bool m_Repeat; /**< determines whether the timer is executed repeatedly */
-	time_t m_Next; /**< the next scheduled time of execution */
-	link_t<CTimer *> *m_Link; /**< link in the timer list */
+	bool m_Milliseconds; /**< whether the interval is specified in milliseconds */
+	mtime_t m_Next; /**< the next scheduled time of execution (monotonic time) */
+	int m_Index; /**< the timer's index in the timer heap, -1 if it isn't in the
+				 heap or -2 - n if it's the n-th item in the list of due timers */
 
-	bool Call(time_t Now);
-	static void RescheduleTimers(void);
+	bool Call(void);
+	mtime_t GetIntervalMs(void) const;
+	void SetNext(mtime_t Next);
+
+	static void HeapInsert(CTimer *Timer);
+	static void HeapRemove(CTimer *Timer);
+	static void HeapUpdate(CTimer *Timer);
+	static void HeapSiftUp(int Index);
+	static void HeapSiftDown(int Index);
 
 public:
 #ifndef SWIG
-	CTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie);
+	CTimer(unsigned int Interval, bool Repeat, TimerProc Function, void *Cookie, bool Milliseconds = false);
 	virtual ~CTimer(void);
 #endif /* SWIG */
 
 	static time_t GetNextCall(void);
+	static mtime_t GetNextCallMonotonic(void);
 	static void DestroyAllTimers(void);
 	static void CallTimers(void);
 
 	int GetInterval(void) const;
 	bool GetRepeat(void) const;
+	bool GetMilliseconds(void) const;
 
 	void Reschedule(time_t Next);
 
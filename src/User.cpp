@@ -2044,3 +2044,89 @@ void CUser::SetAutoBacklog(const char *Value) {
 const char *CUser::GetAutoBacklog(void) {
 	return CacheGetString(m_ConfigCache, autobacklog);
 }
+
+/**
+ * SetFloodRate
+ *
+ * Sets the number of lines per minute which are sent to the IRC server
+ * once the user's flood burst has been used up.
+ *
+ * @param Rate the number of lines (0 for the default rate)
+ */
+void CUser::SetFloodRate(unsigned int Rate) {
+	CacheSetInteger(m_ConfigCache, floodrate, Rate);
+
+	if (m_IRC != NULL) {
+		m_IRC->GetFloodControl()->SetRate(GetFloodRate(), GetFloodBurst());
+	}
+}
+
+/**
+ * GetFloodRate
+ *
+ * Returns the number of lines per minute which are sent to the IRC server.
+ */
+unsigned int CUser::GetFloodRate(void) const {
+	int Rate = CacheGetInteger(m_ConfigCache, floodrate);
+
+	if (Rate <= 0) {
+		return FLOODRATE;
+	} else {
+		return Rate;
+	}
+}
+
+/**
+ * SetFloodBurst
+ *
+ * Sets the number of lines which can be sent to the IRC server at once.
+ *
+ * @param Burst the number of lines (0 for the default burst)
+ */
+void CUser::SetFloodBurst(unsigned int Burst) {
+	CacheSetInteger(m_ConfigCache, floodburst, Burst);
+
+	if (m_IRC != NULL) {
+		m_IRC->GetFloodControl()->SetRate(GetFloodRate(), GetFloodBurst());
+	}
+}
+
+/**
+ * GetFloodBurst
+ *
+ * Returns the number of lines which can be sent to the IRC server at once.
+ */
+unsigned int CUser::GetFloodBurst(void) const {
+	int Burst = CacheGetInteger(m_ConfigCache, floodburst);
+
+	if (Burst <= 0) {
+		return FLOODBURST;
+	} else {
+		return Burst;
+	}
+}
+
+/**
+ * SetFloodFairness
+ *
+ * Sets whether lines for other targets are sent in between lines for
+ * a single busy channel or nick.
+ *
+ * @param Fairness a boolean flag
+ */
+void CUser::SetFloodFairness(bool Fairness) {
+	CacheSetInteger(m_ConfigCache, floodfairness, Fairness ? 1 : 0);
+
+	if (m_IRC != NULL) {
+		m_IRC->GetFloodControl()->SetFairness(Fairness);
+	}
+}
+
+/**
+ * GetFloodFairness
+ *
+ * Returns whether per-target fairness is enabled for the user's IRC connection.
+ */
+bool CUser::GetFloodFairness(void) const {
+	return CacheGetInteger(m_ConfigCache, floodfairness) > 0;
+}
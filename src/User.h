@@ -42,6 +42,9 @@ DEFINE_CACHE(User)
 	DEFINE_OPTION_INT(ignsysnotices);
 	DEFINE_OPTION_INT(lean);
 	DEFINE_OPTION_INT(quitaway);
+	DEFINE_OPTION_INT(floodrate);
+	DEFINE_OPTION_INT(floodburst);
+	DEFINE_OPTION_INT(floodfairness);
 
 	DEFINE_OPTION_STRING(automodes);
 	DEFINE_OPTION_STRING(dropmodes);
@@ -293,6 +296,15 @@ public:
 
 	void SetAutoBacklog(const char *Value);
 	const char *GetAutoBacklog(void);
+
+	void SetFloodRate(unsigned int Rate);
+	unsigned int GetFloodRate(void) const;
+
+	void SetFloodBurst(unsigned int Burst);
+	unsigned int GetFloodBurst(void) const;
+
+	void SetFloodFairness(bool Fairness);
+	bool GetFloodFairness(void) const;
 };
 
 #endif /* USER_H */
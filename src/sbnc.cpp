@@ -526,6 +526,7 @@ int main(int argc, char **argv) {
 #endif
 
 	time(&g_CurrentTime);
+	g_MonotonicTime = GetMonotonicTime();
 
 	Config = new CConfig(sbncBuildPath("sbnc.conf", NULL), NULL);
 
@@ -43,6 +43,18 @@
 #include <termios.h>
 #include <strings.h>
 
+#ifdef HAVE_SYS_EPOLL_H
+#	include <sys/epoll.h>
+#endif /* HAVE_SYS_EPOLL_H */
+
+#ifdef HAVE_SYS_UIO_H
+#	include <sys/uio.h>
+#endif /* HAVE_SYS_UIO_H */
+
+#ifdef HAVE_PTHREAD_H
+#	include <pthread.h>
+#endif /* HAVE_PTHREAD_H */
+
 typedef int SOCKET;
 
 #define SD_BOTH SHUT_RDWR
@@ -335,6 +335,233 @@ unsigned int ArgCount2(const tokendata_t& Tokens) {
 	return Tokens.Count;
 }
 
+/**
+ * ArgTokenizeMessage
+ *
+ * Splits an IRC message into its tags, prefix, command and parameters.
+ * Lines which are longer than IRCMESSAGE_MAXLENGTH are truncated; if there
+ * are more than IRCMESSAGE_MAXTOKENS tokens the last token contains the
+ * rest of the line.
+ *
+ * @param Line the line
+ * @param Message the structure which receives the tokenized message
+ */
+void ArgTokenizeMessage(const char *Line, ircmessage_t *Message) {
+	char *Current = Message->String;
+	size_t Length = strlen(Line);
+	int Count = 0;
+	bool HasPrefix = false;
+
+	if (Length > sizeof(Message->String) - 1) {
+		Length = sizeof(Message->String) - 1;
+	}
+
+	memcpy(Message->String, Line, Length);
+	Message->String[Length] = '\0';
+
+	Message->Tags = NULL;
+	Message->Prefix = NULL;
+	Message->Command = NULL;
+	Message->ArgV = Message->Tokens;
+
+	if (*Current == '@') {
+		Message->Tags = Current + 1;
+
+		Current = strchr(Current, ' ');
+
+		if (Current == NULL) {
+			Current = Message->String + Length;
+		} else {
+			*Current++ = '\0';
+		}
+	}
+
+	while (*Current == ' ') {
+		Current++;
+	}
+
+	if (*Current == ':') {
+		HasPrefix = true;
+		Current++;
+	}
+
+	while (*Current != '\0') {
+		// a leading colon marks the last parameter (which may contain spaces)
+		if (Count > 0 && *Current == ':') {
+			Message->Tokens[Count++] = Current + 1;
+
+			break;
+		}
+
+		Message->Tokens[Count++] = Current;
+
+		if (Count == IRCMESSAGE_MAXTOKENS) {
+			break;
+		}
+
+		Current = strchr(Current, ' ');
+
+		if (Current == NULL) {
+			break;
+		}
+
+		*Current++ = '\0';
+
+		while (*Current == ' ') {
+			Current++;
+		}
+	}
+
+	Message->Tokens[Count] = NULL;
+	Message->ArgC = Count;
+
+	if (Count > 0 && HasPrefix) {
+		Message->Prefix = Message->Tokens[0];
+		Message->Command = Message->Tokens[1];
+	} else {
+		Message->Command = Message->Tokens[0];
+	}
+}
+
+/**
+ * ArgStripTags
+ *
+ * Returns a pointer to the part of an IRC line which follows the line's
+ * tags. The line itself is returned if it does not have any tags.
+ *
+ * @param Line the line
+ */
+const char *ArgStripTags(const char *Line) {
+	if (*Line != '@') {
+		return Line;
+	}
+
+	while (*Line != '\0' && *Line != ' ') {
+		Line++;
+	}
+
+	while (*Line == ' ') {
+		Line++;
+	}
+
+	return Line;
+}
+
+/**
+ * ArgIsTagmsg
+ *
+ * Checks whether an IRC line is a TAGMSG, i.e. a message which consists of
+ * nothing but its tags.
+ *
+ * @param Line the line
+ */
+bool ArgIsTagmsg(const char *Line) {
+	Line = ArgStripTags(Line);
+
+	if (*Line == ':') {
+		Line = strchr(Line, ' ');
+
+		if (Line == NULL) {
+			return false;
+		}
+
+		while (*Line == ' ') {
+			Line++;
+		}
+	}
+
+	return strncasecmp(Line, "TAGMSG", 6) == 0 && (Line[6] == ' ' || Line[6] == '\0');
+}
+
+/**
+ * ArgGetTag
+ *
+ * Looks up a tag and decodes its value. Returns false if the tag could not
+ * be found. Tags without a value have an empty value.
+ *
+ * @param Tags the tags (without the leading '@')
+ * @param Name the tag's name
+ * @param Value a buffer for the tag's value (may be NULL)
+ * @param Size the size of the buffer
+ */
+bool ArgGetTag(const char *Tags, const char *Name, char *Value, size_t Size) {
+	size_t NameLength = strlen(Name);
+	const char *Current = Tags;
+
+	if (Current == NULL) {
+		return false;
+	}
+
+	while (*Current != '\0' && *Current != ' ') {
+		if (strncmp(Current, Name, NameLength) == 0 &&
+				(Current[NameLength] == '=' || Current[NameLength] == ';' ||
+				Current[NameLength] == ' ' || Current[NameLength] == '\0')) {
+			break;
+		}
+
+		while (*Current != '\0' && *Current != ' ' && *Current != ';') {
+			Current++;
+		}
+
+		if (*Current == ';') {
+			Current++;
+		}
+	}
+
+	if (*Current == '\0' || *Current == ' ') {
+		return false;
+	}
+
+	if (Value == NULL || Size == 0) {
+		return true;
+	}
+
+	Current += NameLength;
+
+	if (*Current == '=') {
+		Current++;
+	}
+
+	size_t Length = 0;
+
+	while (*Current != '\0' && *Current != ' ' && *Current != ';' && Length < Size - 1) {
+		char Character = *Current++;
+
+		// escape sequences as defined by the IRCv3 message-tags specification
+		if (Character == '\\') {
+			switch (*Current) {
+				case ':':
+					Character = ';';
+					break;
+				case 's':
+					Character = ' ';
+					break;
+				case 'r':
+					Character = '\r';
+					break;
+				case 'n':
+					Character = '\n';
+					break;
+				case '\0':
+				case ' ':
+				case ';':
+					continue;
+				default:
+					Character = *Current;
+					break;
+			}
+
+			Current++;
+		}
+
+		Value[Length++] = Character;
+	}
+
+	Value[Length] = '\0';
+
+	return true;
+}
+
 /**
  * SocketAndConnect
  *
@@ -520,14 +747,17 @@ char *NickFromHostmask(const char *Hostmask) {
  * @param Port the port this socket should listen on
  * @param BindIp the IP address this socket should be bound to
  * @param Family address family (i.e. IPv4 or IPv6)
+ * @param ReusePort whether other sockets may listen on the same port
+ *                  (so the kernel distributes new connections among them)
  */
-SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family) {
+SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family, bool ReusePort) {
 	sockaddr *saddr;
 	sockaddr_in sin;
 #ifdef HAVE_IPV6
 	sockaddr_in6 sin6;
 #endif /* HAVE_IPV6 */
 	const int optTrue = 1;
+	unsigned long lTrue = 1;
 	bool Bound = false;
 	SOCKET Listener;
 	hostent *hent;
@@ -538,10 +768,20 @@ SOCKET CreateListener(unsigned int Port, const char *BindIp, int Family) {
 		return INVALID_SOCKET;
 	}
 
+	// CListenerBase accepts connections until accept() would block
+	ioctlsocket(Listener, FIONBIO, &lTrue);
+
 #ifndef _WIN32
 	setsockopt(Listener, SOL_SOCKET, SO_REUSEADDR, (char *)&optTrue, sizeof(optTrue));
 #endif
 
+#ifdef SO_REUSEPORT
+	// without SO_REUSEPORT any further listeners for this port will fail to bind
+	if (ReusePort) {
+		setsockopt(Listener, SOL_SOCKET, SO_REUSEPORT, (char *)&optTrue, sizeof(optTrue));
+	}
+#endif /* SO_REUSEPORT */
+
 #ifdef HAVE_IPV6
 	if (Family == AF_INET) {
 #endif /* HAVE_IPV6 */
@@ -1312,6 +1552,33 @@ lt_dlhandle sbncLoadLibrary(const char *Filename) {
 }
 #endif
 
+/**
+ * GetMonotonicTime
+ *
+ * Returns the value of a monotonic clock in milliseconds. Unlike time()
+ * this clock isn't affected by changes to the system time.
+ */
+mtime_t GetMonotonicTime(void) {
+#ifdef _WIN32
+	return GetTickCount64();
+#else /* _WIN32 */
+#	if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	timespec MonotonicNow;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &MonotonicNow) == 0) {
+		return (mtime_t)MonotonicNow.tv_sec * 1000 + MonotonicNow.tv_nsec / 1000000;
+	}
+#	endif /* HAVE_CLOCK_GETTIME && CLOCK_MONOTONIC */
+
+	// fall back to the system time
+	timeval Now;
+
+	gettimeofday(&Now, NULL);
+
+	return (mtime_t)Now.tv_sec * 1000 + Now.tv_usec / 1000;
+#endif /* _WIN32 */
+}
+
 void gfree(void *ptr) {
 	/**
 	 * Win32 might have separate heaps for sbnc and its modules (depending
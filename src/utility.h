@@ -65,10 +65,34 @@ const char **ArgToArray2(const tokendata_t& Tokens);
 const char *ArgGet2(const tokendata_t& Tokens, unsigned int Arg);
 unsigned int ArgCount2(const tokendata_t& Tokens);
 
+#define IRCMESSAGE_MAXTOKENS 32 /**< the maximum number of tokens (prefix, command and parameters) */
+#define IRCMESSAGE_MAXLENGTH 8704 /**< the maximum length of a line (8191 bytes for tags plus 512 bytes) */
+
+/**
+ * ircmessage_t
+ *
+ * A tokenized IRC message. All pointers point into the structure's copy
+ * of the line, so tokenizing a line does not allocate any memory.
+ */
+typedef struct ircmessage_s {
+	const char *Tags; /**< the message's tags (without the leading '@') or NULL */
+	const char *Prefix; /**< the message's prefix (without the leading ':') or NULL */
+	const char *Command; /**< the command (or NULL for an empty line) */
+	int ArgC; /**< the number of tokens in ArgV */
+	const char **ArgV; /**< the prefix (if there is one), the command and the parameters */
+	const char *Tokens[IRCMESSAGE_MAXTOKENS + 1]; /**< the NULL-terminated token array for ArgV */
+	char String[IRCMESSAGE_MAXLENGTH]; /**< the tokenized line */
+} ircmessage_t;
+
+void ArgTokenizeMessage(const char *Line, ircmessage_t *Message);
+const char *ArgStripTags(const char *Line);
+bool ArgIsTagmsg(const char *Line);
+bool ArgGetTag(const char *Tags, const char *Name, char *Value, size_t Size);
+
 SOCKET SocketAndConnect(const char *Host, unsigned int Port, const char *BindIp = NULL);
 SOCKET SocketAndConnectResolved(const sockaddr *Host, const sockaddr *BindIp, int *error);
 
-SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET);
+SOCKET CreateListener(unsigned int Port, const char *BindIp = NULL, int Family = AF_INET, bool ReusePort = false);
 
 char *NickFromHostmask(const char *Hostmask);
 
@@ -107,6 +131,10 @@ SBNCAPI bool StringToIp(const char *IP, int Family, sockaddr *SockAddr, socklen_
 SBNCAPI int CompareAddress(const sockaddr *pA, const sockaddr *pB);
 SBNCAPI const sockaddr *HostEntToSockAddr(hostent *HostEnt);
 
+typedef unsigned long long mtime_t; /**< a monotonic timestamp in milliseconds */
+
+SBNCAPI mtime_t GetMonotonicTime(void);
+
 int SetPermissions(const char *Filename, int Modes);
 
 void FreeString(char *String);